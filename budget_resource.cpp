@@ -0,0 +1,650 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <list>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+// Byte budget of a tenant, team or process, arranged in a tree.
+// A node charges its own atomic counter and takes room from its parent in
+// quanta, so an allocation costs one atomic add on the leaf and the upper
+// levels are only touched once per quantum. Limits of inner nodes are
+// therefore enforced to within a quantum per child.
+// Crossing the soft limit, and every hard failure, runs the trim hooks of the
+// node and of everything below it. Hooks run on whatever thread crossed the
+// limit, possibly inside some pool's upstream call, so they should only
+// flag work for their owner.
+class budget
+{
+public:
+    static constexpr std::size_t no_limit = SIZE_MAX;
+
+    explicit budget(std::size_t hard_limit, std::size_t soft_limit = no_limit,
+                    budget *parent = nullptr, std::size_t quantum = 64 * 1024)
+        : hard_(hard_limit), soft_(std::min(soft_limit, hard_limit)), quantum_(quantum), parent_(parent)
+    {
+        if (parent_)
+        {
+            std::lock_guard<std::mutex> lock(parent_->mutex_);
+            parent_->children_.push_back(this);
+        }
+    }
+
+    budget(const budget &) = delete;
+    budget &operator=(const budget &) = delete;
+
+    ~budget()
+    {
+        if (parent_)
+        {
+            parent_->release(reserved_.load());
+            std::lock_guard<std::mutex> lock(parent_->mutex_);
+            auto &siblings = parent_->children_;
+            siblings.erase(std::find(siblings.begin(), siblings.end(), this));
+        }
+    }
+
+    bool try_charge(std::size_t bytes)
+    {
+        // seq_cst pairs with release(): either this charge sees a lowered
+        // reservation, or release() sees this charge and covers it
+        const std::size_t before = used_.fetch_add(bytes);
+        const std::size_t now = before + bytes;
+        if (now > hard_ || (parent_ && !reserve(now)))
+        {
+            used_.fetch_sub(bytes, std::memory_order_relaxed);
+            hard_failures_.fetch_add(1, std::memory_order_relaxed);
+            request_trim();
+            return false;
+        }
+        if (before <= soft_ && now > soft_)
+        {
+            soft_events_.fetch_add(1, std::memory_order_relaxed);
+            request_trim();
+        }
+        return true;
+    }
+
+    void release(std::size_t bytes)
+    {
+        const std::size_t now = used_.fetch_sub(bytes, std::memory_order_relaxed) - bytes;
+        if (!parent_)
+            return;
+        // keep one spare quantum, the rest goes back up
+        std::size_t r = reserved_.load();
+        while (r > now + 2 * quantum_)
+        {
+            const std::size_t keep = round_up(now) + quantum_;
+            if (reserved_.compare_exchange_weak(r, keep))
+            {
+                give_back(r - keep);
+                return;
+            }
+        }
+    }
+
+    // returns an id for remove_trim_hook
+    std::size_t add_trim_hook(std::function<void()> hook)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        hooks_.push_back({++last_hook_id_, std::move(hook)});
+        return last_hook_id_;
+    }
+
+    void remove_trim_hook(std::size_t id)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        hooks_.erase(std::find_if(hooks_.begin(), hooks_.end(), [id](const hook &h)
+                                  { return h.id == id; }));
+    }
+
+    std::size_t used() const { return used_.load(std::memory_order_relaxed); }
+    std::size_t reserved() const { return reserved_.load(std::memory_order_relaxed); }
+    std::size_t hard_limit() const { return hard_; }
+    std::size_t soft_limit() const { return soft_; }
+    bool under_pressure() const { return used() > soft_; }
+    std::size_t soft_events() const { return soft_events_.load(std::memory_order_relaxed); }
+    std::size_t hard_failures() const { return hard_failures_.load(std::memory_order_relaxed); }
+
+private:
+    struct hook
+    {
+        std::size_t id;
+        std::function<void()> fn;
+    };
+
+    std::size_t round_up(std::size_t bytes) const
+    {
+        return (bytes + quantum_ - 1) / quantum_ * quantum_;
+    }
+
+    // makes the reservation from the parent cover now bytes
+    bool reserve(std::size_t now)
+    {
+        std::size_t r = reserved_.load();
+        while (now > r)
+        {
+            const std::size_t grow = round_up(now - r);
+            if (!parent_->try_charge(grow))
+                return false;
+            if (reserved_.compare_exchange_weak(r, r + grow))
+                return true;
+            parent_->release(grow);
+        }
+        return true;
+    }
+
+    // Returns bytes cut from the reservation to the parent. A charge that
+    // checked the reservation before the cut may have grown used_ past it, so
+    // the shortfall is put back first, out of the bytes that were cut.
+    void give_back(std::size_t bytes)
+    {
+        std::size_t r = reserved_.load();
+        for (std::size_t now = used_.load(); bytes && now > r; now = used_.load())
+        {
+            const std::size_t take = std::min(bytes, round_up(now - r));
+            if (reserved_.compare_exchange_weak(r, r + take))
+            {
+                bytes -= take;
+                r += take;
+            }
+        }
+        if (bytes)
+            parent_->release(bytes);
+    }
+
+    // top-down, so the locks are always taken parent first
+    void request_trim()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto &h : hooks_)
+        {
+            h.fn();
+        }
+        for (budget *child : children_)
+        {
+            child->request_trim();
+        }
+    }
+
+    const std::size_t hard_;
+    const std::size_t soft_;
+    const std::size_t quantum_;
+    budget *const parent_;
+
+    // the hot counter gets a cache line of its own
+    alignas(64) std::atomic<std::size_t> used_{0};
+    alignas(64) std::atomic<std::size_t> reserved_{0}; // taken from the parent
+    std::atomic<std::size_t> soft_events_{0};
+    std::atomic<std::size_t> hard_failures_{0};
+
+    std::mutex mutex_; // hooks and children
+    std::vector<hook> hooks_;
+    std::vector<budget *> children_;
+    std::size_t last_hook_id_ = 0;
+};
+
+// Charges every byte it passes on to the upstream against a budget,
+// bad_alloc when the budget or one of its ancestors is exhausted.
+class budget_resource : public std::pmr::memory_resource
+{
+public:
+    explicit budget_resource(budget &b, std::pmr::memory_resource *upstream = std::pmr::get_default_resource())
+        : budget_(b), upstream_(upstream) {}
+
+    budget &get_budget() const { return budget_; }
+    std::pmr::memory_resource *upstream_resource() const { return upstream_; }
+
+private:
+    void *do_allocate(std::size_t bytes, std::size_t align) override
+    {
+        if (!budget_.try_charge(bytes))
+            throw std::bad_alloc();
+        try
+        {
+            return upstream_->allocate(bytes, align);
+        }
+        catch (...)
+        {
+            budget_.release(bytes);
+            throw;
+        }
+    }
+
+    void do_deallocate(void *p, std::size_t bytes, std::size_t align) override
+    {
+        upstream_->deallocate(p, bytes, align);
+        budget_.release(bytes);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+    {
+        return this == &other;
+    }
+
+    budget &budget_;
+    std::pmr::memory_resource *upstream_;
+};
+
+// The same accounting for a resource used by one thread: the budget is
+// charged in batches and allocations are served from the prepaid credit with
+// plain arithmetic. The budget sees up to two batches more than is really
+// allocated. Not thread safe, like unsynchronized_pool_resource.
+class unsynchronized_budget_resource : public std::pmr::memory_resource
+{
+public:
+    explicit unsynchronized_budget_resource(budget &b, std::pmr::memory_resource *upstream = std::pmr::get_default_resource(),
+                                            std::size_t batch = 16 * 1024)
+        : budget_(b), upstream_(upstream), batch_(batch) {}
+
+    unsynchronized_budget_resource(const unsynchronized_budget_resource &) = delete;
+    unsynchronized_budget_resource &operator=(const unsynchronized_budget_resource &) = delete;
+
+    ~unsynchronized_budget_resource() { budget_.release(credit_); }
+
+    budget &get_budget() const { return budget_; }
+    std::pmr::memory_resource *upstream_resource() const { return upstream_; }
+
+private:
+    // a full batch when there is room, otherwise just what this call needs
+    void refill(std::size_t bytes)
+    {
+        const std::size_t missing = bytes - credit_;
+        if (budget_.try_charge(missing + batch_))
+            credit_ += missing + batch_;
+        else if (budget_.try_charge(missing))
+            credit_ += missing;
+        else
+            throw std::bad_alloc();
+    }
+
+    void *do_allocate(std::size_t bytes, std::size_t align) override
+    {
+        if (bytes > credit_)
+            refill(bytes);
+        credit_ -= bytes;
+        try
+        {
+            return upstream_->allocate(bytes, align);
+        }
+        catch (...)
+        {
+            credit_ += bytes;
+            throw;
+        }
+    }
+
+    void do_deallocate(void *p, std::size_t bytes, std::size_t align) override
+    {
+        upstream_->deallocate(p, bytes, align);
+        credit_ += bytes;
+        if (credit_ > 2 * batch_)
+        {
+            budget_.release(credit_ - batch_);
+            credit_ = batch_;
+        }
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+    {
+        return this == &other;
+    }
+
+    budget &budget_;
+    std::pmr::memory_resource *upstream_;
+    const std::size_t batch_;
+    std::size_t credit_ = 0;
+};
+
+// Per-tenant cache of freed small blocks, one free list per 16-byte class.
+// Unlike the standard pools it can give back just its unused blocks: trim()
+// returns every cached block to the upstream. The hook registered on the
+// budget only flags the trim, the next allocate or deallocate carries it out,
+// so a hook fired by another thread never touches the lists. While the budget
+// is over its soft limit freed blocks go straight back instead of being cached.
+// Not thread safe, like unsynchronized_pool_resource.
+class block_cache_resource : public std::pmr::memory_resource
+{
+public:
+    static constexpr std::size_t granularity = 16;
+    static constexpr std::size_t max_block = 1024;
+
+    explicit block_cache_resource(std::pmr::memory_resource *upstream, budget *b = nullptr)
+        : upstream_(upstream), budget_(b)
+    {
+        if (budget_)
+            hook_id_ = budget_->add_trim_hook([this]
+                                              { trim_requested_.store(true, std::memory_order_relaxed); });
+    }
+
+    block_cache_resource(const block_cache_resource &) = delete;
+    block_cache_resource &operator=(const block_cache_resource &) = delete;
+
+    ~block_cache_resource()
+    {
+        if (budget_)
+            budget_->remove_trim_hook(hook_id_);
+        trim();
+    }
+
+    void trim()
+    {
+        for (std::size_t c = 0; c != lists_.size(); ++c)
+        {
+            while (free_block *b = lists_[c])
+            {
+                lists_[c] = b->next;
+                upstream_->deallocate(b, (c + 1) * granularity, granularity);
+            }
+        }
+        cached_bytes_ = 0;
+        ++trims_;
+    }
+
+    std::size_t cached_bytes() const { return cached_bytes_; }
+    std::size_t trims() const { return trims_; }
+
+private:
+    struct free_block
+    {
+        free_block *next;
+    };
+
+    static std::size_t class_of(std::size_t bytes) { return (std::max(bytes, std::size_t{1}) - 1) / granularity; }
+
+    void trim_if_requested()
+    {
+        if (trim_requested_.load(std::memory_order_relaxed) && trim_requested_.exchange(false, std::memory_order_relaxed))
+            trim();
+    }
+
+    void *do_allocate(std::size_t bytes, std::size_t align) override
+    {
+        trim_if_requested();
+        if (bytes > max_block || align > granularity)
+            return upstream_->allocate(bytes, align);
+
+        const std::size_t c = class_of(bytes);
+        if (free_block *b = lists_[c])
+        {
+            lists_[c] = b->next;
+            cached_bytes_ -= (c + 1) * granularity;
+            return b;
+        }
+        try
+        {
+            return upstream_->allocate((c + 1) * granularity, granularity);
+        }
+        catch (const std::bad_alloc &)
+        {
+            // our own cache is the last thing to give up before failing
+            trim();
+            return upstream_->allocate((c + 1) * granularity, granularity);
+        }
+    }
+
+    void do_deallocate(void *p, std::size_t bytes, std::size_t align) override
+    {
+        trim_if_requested();
+        if (bytes > max_block || align > granularity)
+            return upstream_->deallocate(p, bytes, align);
+
+        const std::size_t c = class_of(bytes);
+        if (budget_ && budget_->under_pressure())
+            return upstream_->deallocate(p, (c + 1) * granularity, granularity);
+        auto *b = static_cast<free_block *>(p);
+        b->next = lists_[c];
+        lists_[c] = b;
+        cached_bytes_ += (c + 1) * granularity;
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+    {
+        return this == &other;
+    }
+
+    std::pmr::memory_resource *upstream_;
+    budget *budget_;
+    std::size_t hook_id_ = 0;
+    std::array<free_block *, max_block / granularity> lists_{};
+    std::size_t cached_bytes_ = 0;
+    std::size_t trims_ = 0;
+    std::atomic<bool> trim_requested_{false};
+};
+
+template <typename Func>
+auto benchmark(Func test_func, int iterations)
+{
+    const auto start = std::chrono::system_clock::now();
+    while (iterations-- > 0)
+    {
+        test_func();
+    }
+    const auto stop = std::chrono::system_clock::now();
+    const auto secs = std::chrono::duration<double>(stop - start);
+    return secs.count();
+}
+
+// cost of the accounting itself: every call reaches the budget
+void test_overhead()
+{
+    constexpr int iterations{2'000'000};
+    constexpr int rounds{7};
+    std::vector<void *> live(64, nullptr);
+    std::size_t n = 0;
+    auto churn = [&](std::pmr::memory_resource *r)
+    {
+        const double secs = benchmark([&]
+                                      {
+                                          void *&slot = live[n++ % live.size()];
+                                          if (slot)
+                                              r->deallocate(slot, 64);
+                                          slot = r->allocate(64); },
+                                      iterations);
+        for (auto &slot : live)
+        {
+            if (slot)
+                r->deallocate(slot, 64);
+            slot = nullptr;
+        }
+        return secs;
+    };
+
+    std::pmr::memory_resource *heap = std::pmr::new_delete_resource();
+    budget root(1ull << 30);
+    budget team(256 << 20, budget::no_limit, &root);
+    budget tenant(64 << 20, 48 << 20, &team);
+    budget_resource flat(root, heap);
+    budget_resource nested(tenant, heap);
+    unsynchronized_budget_resource batched(tenant, heap);
+
+    // interleaved rounds, the best of each, so noise of a shared host cancels out
+    std::array<std::pmr::memory_resource *, 4> resources{heap, &flat, &nested, &batched};
+    std::array<double, 4> best;
+    best.fill(1e9);
+    for (int round{}; round != rounds; ++round)
+    {
+        for (std::size_t i{}; i != resources.size(); ++i)
+        {
+            best[i] = std::min(best[i], churn(resources[i]));
+        }
+    }
+
+    auto ns = [](double secs)
+    { return secs * 1e9 / iterations; };
+    const char *names[] = {"t1 (new_delete_resource):          ",
+                           "t2 (budget_resource, 1 level):     ",
+                           "t3 (budget_resource, 3 levels):    ",
+                           "t4 (unsynchronized, 3 levels):     "};
+    std::cout << std::fixed << "accounting overhead, allocate/deallocate pairs of 64 bytes, best of " << rounds << ":\n";
+    for (std::size_t i{}; i != best.size(); ++i)
+    {
+        std::cout << "  " << names[i] << best[i] << " sec; " << ns(best[i]) << " ns/pair";
+        if (i)
+            std::cout << " (+" << ns(best[i] - best[0]) << ")";
+        std::cout << '\n';
+    }
+}
+
+struct payload
+{
+    char bytes[64];
+};
+
+// two tenants taking turns on one thread, each swinging between a small and
+// a large working set in opposite phase; their peaks only fit under the
+// process budget if the idle tenant's cached blocks are given back
+void test_tenants(bool trim_hooks)
+{
+    constexpr std::size_t MiB = 1 << 20;
+    budget process(14 * MiB, 11 * MiB);
+    budget tenant_a(10 * MiB, 9 * MiB, &process);
+    budget tenant_b(10 * MiB, 9 * MiB, &process);
+    budget_resource acct_a(tenant_a, std::pmr::new_delete_resource());
+    budget_resource acct_b(tenant_b, std::pmr::new_delete_resource());
+    block_cache_resource cache_a(&acct_a, trim_hooks ? &tenant_a : nullptr);
+    block_cache_resource cache_b(&acct_b, trim_hooks ? &tenant_b : nullptr);
+
+    std::pmr::list<payload> a(&cache_a);
+    std::pmr::list<payload> b(&cache_b);
+    std::size_t failures = 0;
+    std::size_t peak = 0;
+    constexpr std::size_t large = 100'000; // about 8 MiB of nodes
+    constexpr std::size_t small = 10'000;
+    constexpr std::size_t step = 5'000;
+
+    for (int tick{}; tick != 400; ++tick)
+    {
+        const bool a_turn = tick % 2 == 0;
+        const bool a_busy = (tick / 100) % 2 == 0;
+        auto &list = a_turn ? a : b;
+        const std::size_t target = a_turn == a_busy ? large : small;
+        try
+        {
+            for (std::size_t i{}; i != step && list.size() < target; ++i)
+            {
+                list.emplace_back();
+            }
+        }
+        catch (const std::bad_alloc &)
+        {
+            ++failures;
+        }
+        for (std::size_t i{}; i != step && list.size() > target; ++i)
+        {
+            list.pop_back();
+        }
+        peak = std::max(peak, process.used());
+    }
+
+    std::cout << (trim_hooks ? "  with trim hooks:    " : "  without trim hooks: ")
+              << "failed bursts = " << failures << ", peak = " << peak / MiB << " MiB"
+              << ", soft limit crossings = " << process.soft_events() + tenant_a.soft_events() + tenant_b.soft_events()
+              << ", trims = " << cache_a.trims() + cache_b.trims()
+              << ", still cached = " << (cache_a.cached_bytes() + cache_b.cached_bytes()) / 1024 << " kB\n";
+    a.clear();
+    b.clear();
+}
+
+// Charges and releases from several threads on children of one parent.
+// Whenever the threads are stopped every child must have reserved at least
+// what it uses, and the parent must be charged for at least the children.
+bool test_concurrent_accounting()
+{
+    constexpr int threads{4};
+    constexpr int rounds{50};
+    constexpr int ops{20'000};
+    budget parent(budget::no_limit);
+    budget child_a(budget::no_limit, budget::no_limit, &parent, 4096);
+    budget child_b(budget::no_limit, budget::no_limit, &parent, 4096);
+    budget *children[] = {&child_a, &child_b};
+
+    std::size_t violations = 0;
+    std::vector<std::vector<std::size_t>> held(threads);
+    for (int round{}; round != rounds; ++round)
+    {
+        std::vector<std::thread> workers;
+        for (int t{}; t != threads; ++t)
+        {
+            workers.emplace_back([&, t]
+                                 {
+                                     budget &b = *children[t % 2];
+                                     auto &mine = held[t];
+                                     std::uint32_t x = 2654435761u * static_cast<std::uint32_t>(round * threads + t + 1);
+                                     for (int i{}; i != ops; ++i)
+                                     {
+                                         x ^= x << 13;
+                                         x ^= x >> 17;
+                                         x ^= x << 5;
+                                         // mostly small steps, now and then a large swing either way
+                                         if (x % 64 == 0 && !mine.empty())
+                                         {
+                                             for (std::size_t bytes : mine)
+                                             {
+                                                 b.release(bytes);
+                                             }
+                                             mine.clear();
+                                         }
+                                         else if (x % 64 == 1)
+                                         {
+                                             if (b.try_charge(256 * 1024))
+                                                 mine.push_back(256 * 1024);
+                                         }
+                                         else if (x % 2 && !mine.empty())
+                                         {
+                                             b.release(mine.back());
+                                             mine.pop_back();
+                                         }
+                                         else if (b.try_charge(1 + x % 4096))
+                                         {
+                                             mine.push_back(1 + x % 4096);
+                                         }
+                                     } });
+        }
+        for (auto &w : workers)
+        {
+            w.join();
+        }
+
+        std::size_t children_used = 0;
+        for (budget *c : children)
+        {
+            violations += c->reserved() < c->used();
+            children_used += c->used();
+        }
+        violations += parent.used() < children_used;
+    }
+
+    std::cout << threads << " threads, " << rounds << " rounds of " << ops << " charges/releases on 2 children: "
+              << "reservation or parent charge below use " << violations << " times\n";
+    for (int t{}; t != threads; ++t)
+    {
+        for (std::size_t bytes : held[t])
+        {
+            children[t % 2]->release(bytes);
+        }
+    }
+    return violations == 0;
+}
+
+int main()
+{
+    if (!test_concurrent_accounting())
+        return 1;
+
+    test_overhead();
+
+    std::cout << "two tenants under a 14 MiB process budget (soft 11 MiB):\n";
+    test_tenants(false);
+    test_tenants(true);
+
+    return 0;
+}
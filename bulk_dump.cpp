@@ -0,0 +1,331 @@
+#include "my_pool_alloc.h"
+
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// Buffered output to a file descriptor for dumping big containers.
+// Text goes into one reusable buffer, integers and floating-point values are
+// formatted in place with std::to_chars, and a full buffer leaves with a
+// single write(). A piece too big to be worth copying leaves together with the
+// buffer in one writev().
+// Binary mode copies the bytes of trivially copyable values as they are.
+// Errors throw std::system_error; the destructor flushes and swallows them.
+class dump_writer
+{
+public:
+    explicit dump_writer(int fd, std::size_t buffer_size = 1 << 20)
+        : fd_(fd), buf_(new char[buffer_size]), cap_(buffer_size)
+    {
+    }
+
+    dump_writer(const dump_writer &) = delete;
+    dump_writer &operator=(const dump_writer &) = delete;
+
+    ~dump_writer()
+    {
+        try
+        {
+            flush();
+        }
+        catch (...)
+        {
+        }
+    }
+
+    // exactly char: a double or an int must not slip in through a conversion
+    template <class C, std::enable_if_t<std::is_same_v<C, char>, int> = 0>
+    dump_writer &put(C c)
+    {
+        if (len_ == cap_)
+            flush();
+        buf_[len_++] = c;
+        return *this;
+    }
+
+    dump_writer &put(std::string_view s)
+    {
+        if (s.size() <= cap_ - len_)
+        {
+            std::memcpy(buf_.get() + len_, s.data(), s.size());
+            len_ += s.size();
+        }
+        else if (s.size() < cap_ / 2)
+        {
+            flush();
+            std::memcpy(buf_.get(), s.data(), s.size());
+            len_ = s.size();
+        }
+        else
+        {
+            write_with_buffer(s);
+        }
+        return *this;
+    }
+
+    template <class Int, std::enable_if_t<std::is_integral_v<Int> && !std::is_same_v<Int, char> && !std::is_same_v<Int, bool>, int> = 0>
+    dump_writer &put(Int v)
+    {
+        // the longest 64-bit integer with its sign
+        constexpr std::size_t max_digits = 20;
+        if (cap_ - len_ < max_digits)
+            flush();
+        const auto r = std::to_chars(buf_.get() + len_, buf_.get() + cap_, v);
+        len_ = static_cast<std::size_t>(r.ptr - buf_.get());
+        return *this;
+    }
+
+    // shortest representation that reads back to the same value
+    template <class Float, std::enable_if_t<std::is_floating_point_v<Float>, int> = 0>
+    dump_writer &put(Float v)
+    {
+        // more than the longest long double in scientific notation
+        constexpr std::size_t max_chars = 64;
+        if (cap_ - len_ < max_chars)
+            flush();
+        const auto r = std::to_chars(buf_.get() + len_, buf_.get() + cap_, v);
+        len_ = static_cast<std::size_t>(r.ptr - buf_.get());
+        return *this;
+    }
+
+    template <class T>
+    dump_writer &put_binary(const T &v)
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "binary dumps copy raw bytes");
+        return put(std::string_view(reinterpret_cast<const char *>(&v), sizeof(T)));
+    }
+
+    void flush()
+    {
+        const char *p = buf_.get();
+        std::size_t n = len_;
+        len_ = 0;
+        while (n)
+        {
+            const ssize_t w = ::write(fd_, p, n);
+            if (w < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                throw std::system_error(errno, std::generic_category(), "dump_writer: write");
+            }
+            p += w;
+            n -= static_cast<std::size_t>(w);
+            ++writes_;
+        }
+    }
+
+    // write and writev calls so far
+    std::size_t writes() const { return writes_; }
+
+private:
+    void write_with_buffer(std::string_view s)
+    {
+        iovec iov[2] = {{buf_.get(), len_}, {const_cast<char *>(s.data()), s.size()}};
+        iovec *v = iov;
+        int count = 2;
+        len_ = 0;
+        while (count)
+        {
+            const ssize_t w = ::writev(fd_, v, count);
+            if (w < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                throw std::system_error(errno, std::generic_category(), "dump_writer: writev");
+            }
+            ++writes_;
+            std::size_t done = static_cast<std::size_t>(w);
+            while (count && done >= v->iov_len)
+            {
+                done -= v->iov_len;
+                ++v;
+                --count;
+            }
+            if (count)
+            {
+                v->iov_base = static_cast<char *>(v->iov_base) + done;
+                v->iov_len -= done;
+            }
+        }
+    }
+
+    int fd_;
+    std::unique_ptr<char[]> buf_;
+    std::size_t cap_;
+    std::size_t len_ = 0;
+    std::size_t writes_ = 0;
+};
+
+// "key = K -> value = V" per entry, the format of the map loops in the examples
+template <class Map>
+void dump_map(dump_writer &out, const Map &m)
+{
+    for (const auto &entry : m)
+    {
+        out.put("key = ").put(entry.first).put(" -> value = ").put(entry.second).put('\n');
+    }
+}
+
+// one element per line
+template <class Range>
+void dump_range(dump_writer &out, const Range &r)
+{
+    for (const auto &x : r)
+    {
+        out.put(x).put('\n');
+    }
+}
+
+// Binary map dump: the entry count as uint64_t, then key and value bytes of
+// every entry back to back, in the byte order of this machine.
+template <class Map>
+void dump_map_binary(dump_writer &out, const Map &m)
+{
+    out.put_binary(static_cast<std::uint64_t>(m.size()));
+    for (const auto &entry : m)
+    {
+        out.put_binary(entry.first).put_binary(entry.second);
+    }
+}
+
+template <class Map>
+Map load_map_binary(const std::string &path, Map m)
+{
+    std::ifstream in(path, std::ios::binary);
+    std::uint64_t n = 0;
+    in.read(reinterpret_cast<char *>(&n), sizeof(n));
+    typename Map::key_type k;
+    typename Map::mapped_type v;
+    while (n-- && in.read(reinterpret_cast<char *>(&k), sizeof(k)) && in.read(reinterpret_cast<char *>(&v), sizeof(v)))
+    {
+        m.emplace_hint(m.end(), k, v);
+    }
+    return m;
+}
+
+template <typename Func>
+auto benchmark(Func test_func, int iterations)
+{
+    const auto start = std::chrono::system_clock::now();
+    while (iterations-- > 0)
+    {
+        test_func();
+    }
+    const auto stop = std::chrono::system_clock::now();
+    const auto secs = std::chrono::duration<double>(stop - start);
+    return secs.count();
+}
+
+long file_size(const std::string &path)
+{
+    struct stat st;
+    return ::stat(path.c_str(), &st) == 0 ? static_cast<long>(st.st_size) : -1;
+}
+
+int open_out(const std::string &path)
+{
+    const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        throw std::system_error(errno, std::generic_category(), path);
+    return fd;
+}
+
+using pool_map = std::map<int, int, std::less<int>, my_pool_alloc<std::pair<const int, int>>>;
+
+// usage: 23_bulk_dump [entries [output file]]
+int main(int argc, char *argv[])
+{
+    const int n = argc > 1 ? std::atoi(argv[1]) : 10'000'000;
+    const std::string path = argc > 2 ? argv[2] : "/tmp/bulk_dump.out";
+
+    // one block for all nodes, the map frees them in falling address order
+    Pool nodes(64, static_cast<std::size_t>(n));
+    pool_map m{my_pool_alloc<std::pair<const int, int>>(nodes)};
+    const double build = benchmark([&]
+                                   {
+                                       for (int i = 0; i < n; ++i)
+                                       {
+                                           m.emplace_hint(m.end(), i * 7 - n, i * 31);
+                                       } },
+                                   1);
+
+    std::cout << std::fixed << n << " map entries (built in " << build << " sec), dumped to " << path << ":\n";
+    auto report = [&](const char *name, double secs, std::size_t writes)
+    {
+        const long bytes = file_size(path);
+        std::cout << "  " << name << secs << " sec; " << bytes / secs / 1e6 << " MB/s; " << bytes << " bytes";
+        if (writes)
+            std::cout << " in " << writes << " writes";
+        std::cout << '\n';
+    };
+
+    const double t1 = benchmark([&]
+                                {
+                                    std::ofstream out(path);
+                                    for (const auto &entry : m)
+                                    {
+                                        out << "key = " << entry.first << " -> " << "value = " << entry.second << std::endl;
+                                    } },
+                                1);
+    report("t1 (ofstream, std::endl):   ", t1, 0);
+
+    const double t2 = benchmark([&]
+                                {
+                                    std::ofstream out(path);
+                                    for (const auto &entry : m)
+                                    {
+                                        out << "key = " << entry.first << " -> " << "value = " << entry.second << '\n';
+                                    } },
+                                1);
+    report("t2 (ofstream, '\\n'):        ", t2, 0);
+
+    std::size_t writes = 0;
+    const double t3 = benchmark([&]
+                                {
+                                    const int fd = open_out(path);
+                                    {
+                                        dump_writer out(fd);
+                                        dump_map(out, m);
+                                        out.flush();
+                                        writes = out.writes();
+                                    }
+                                    ::close(fd); },
+                                1);
+    report("t3 (dump_writer, text):     ", t3, writes);
+
+    const double t4 = benchmark([&]
+                                {
+                                    const int fd = open_out(path);
+                                    {
+                                        dump_writer out(fd);
+                                        dump_map_binary(out, m);
+                                        out.flush();
+                                        writes = out.writes();
+                                    }
+                                    ::close(fd); },
+                                1);
+    report("t4 (dump_writer, binary):   ", t4, writes);
+
+    Pool reloaded_nodes(64, static_cast<std::size_t>(n));
+    const auto reloaded = load_map_binary(path, pool_map{my_pool_alloc<std::pair<const int, int>>(reloaded_nodes)});
+    std::cout << "  binary dump reloads " << (reloaded == m ? "equal" : "DIFFERENT") << '\n';
+
+    return 0;
+}
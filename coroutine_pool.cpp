@@ -0,0 +1,568 @@
+#include <array>
+#include <chrono>
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace coro
+{
+    // Per-thread free lists of coroutine frames in 32-byte classes up to 1 KiB,
+    // carved from 64 KiB slabs. A frame freed on another thread goes to that
+    // thread's lists. When a thread exits its lists and slabs are parked and
+    // the next new thread adopts them, so no slab is freed while a frame in it
+    // may still be alive.
+    class frame_pool
+    {
+    public:
+        static constexpr std::size_t granularity = 32;
+        static constexpr std::size_t max_frame = 1024;
+        static constexpr std::size_t slab_size = 64 * 1024;
+
+        static frame_pool &local()
+        {
+            thread_local frame_pool pool;
+            return pool;
+        }
+
+        void *allocate(std::size_t n)
+        {
+            if (n > max_frame)
+                return ::operator new(n);
+            const std::size_t c = (n - 1) / granularity;
+            if (free_block *b = state_.lists[c])
+            {
+                state_.lists[c] = b->next;
+                return b;
+            }
+            return carve((c + 1) * granularity);
+        }
+
+        void deallocate(void *p, std::size_t n) noexcept
+        {
+            if (n > max_frame)
+                return ::operator delete(p);
+            const std::size_t c = (n - 1) / granularity;
+            auto *b = static_cast<free_block *>(p);
+            b->next = state_.lists[c];
+            state_.lists[c] = b;
+        }
+
+    private:
+        struct free_block
+        {
+            free_block *next;
+        };
+
+        struct state
+        {
+            std::array<free_block *, max_frame / granularity> lists{};
+            std::vector<void *> slabs;
+            char *cur = nullptr;
+            char *end = nullptr;
+        };
+
+        struct orphanage
+        {
+            std::mutex mutex;
+            std::vector<state> states;
+        };
+
+        // never destroyed, threads may exit during static destruction
+        static orphanage &orphans()
+        {
+            static orphanage *o = new orphanage;
+            return *o;
+        }
+
+        frame_pool()
+        {
+            orphanage &o = orphans();
+            std::lock_guard<std::mutex> lock(o.mutex);
+            if (!o.states.empty())
+            {
+                state_ = std::move(o.states.back());
+                o.states.pop_back();
+            }
+        }
+
+        ~frame_pool()
+        {
+            if (state_.slabs.empty())
+                return;
+            orphanage &o = orphans();
+            std::lock_guard<std::mutex> lock(o.mutex);
+            o.states.push_back(std::move(state_));
+        }
+
+        void *carve(std::size_t bytes)
+        {
+            if (static_cast<std::size_t>(state_.end - state_.cur) < bytes)
+            {
+                state_.slabs.push_back(::operator new(slab_size));
+                state_.cur = static_cast<char *>(state_.slabs.back());
+                state_.end = state_.cur + slab_size;
+            }
+            void *p = state_.cur;
+            state_.cur += bytes;
+            return p;
+        }
+
+        state state_;
+    };
+
+    // Every frame ends with a pointer to the function that frees it, so one
+    // operator delete serves frames from the pool and from any allocator.
+    using frame_deleter = void (*)(void *frame, std::size_t n) noexcept;
+
+    constexpr std::size_t deleter_offset(std::size_t n)
+    {
+        return (n + alignof(frame_deleter) - 1) / alignof(frame_deleter) * alignof(frame_deleter);
+    }
+
+    inline void set_deleter(void *frame, std::size_t n, frame_deleter d)
+    {
+        ::new (static_cast<char *>(frame) + deleter_offset(n)) frame_deleter(d);
+    }
+
+    inline frame_deleter get_deleter(void *frame, std::size_t n)
+    {
+        return *std::launder(reinterpret_cast<frame_deleter *>(static_cast<char *>(frame) + deleter_offset(n)));
+    }
+
+    // frames allocated through Alloc, a copy of which is kept behind the deleter
+    template <class Alloc>
+    struct allocator_frames
+    {
+        struct alignas(__STDCPP_DEFAULT_NEW_ALIGNMENT__) unit
+        {
+            unsigned char bytes[__STDCPP_DEFAULT_NEW_ALIGNMENT__];
+        };
+        using alloc_type = typename std::allocator_traits<Alloc>::template rebind_alloc<unit>;
+        using traits = std::allocator_traits<alloc_type>;
+
+        static constexpr std::size_t alloc_offset(std::size_t n)
+        {
+            const std::size_t end = deleter_offset(n) + sizeof(frame_deleter);
+            return (end + alignof(alloc_type) - 1) / alignof(alloc_type) * alignof(alloc_type);
+        }
+
+        static constexpr std::size_t units(std::size_t n)
+        {
+            return (alloc_offset(n) + sizeof(alloc_type) + sizeof(unit) - 1) / sizeof(unit);
+        }
+
+        static void *allocate(std::size_t n, const Alloc &alloc)
+        {
+            alloc_type a(alloc);
+            void *frame = traits::allocate(a, units(n));
+            ::new (static_cast<char *>(frame) + alloc_offset(n)) alloc_type(std::move(a));
+            set_deleter(frame, n, &deallocate);
+            return frame;
+        }
+
+        static void deallocate(void *frame, std::size_t n) noexcept
+        {
+            auto *stored = std::launder(reinterpret_cast<alloc_type *>(static_cast<char *>(frame) + alloc_offset(n)));
+            alloc_type a(std::move(*stored));
+            stored->~alloc_type();
+            traits::deallocate(a, static_cast<unit *>(frame), units(n));
+        }
+    };
+
+    // Frame policy: promises derive from it to pick where their frames live.
+    // A coroutine whose leading parameters are (std::allocator_arg_t, alloc)
+    // gets its frame from alloc, every other one from the pool of the thread.
+    struct pooled_frames
+    {
+        static void *operator new(std::size_t n)
+        {
+            void *frame = frame_pool::local().allocate(deleter_offset(n) + sizeof(frame_deleter));
+            set_deleter(frame, n, &release_to_pool);
+            return frame;
+        }
+
+        template <class Alloc, class... Args>
+        static void *operator new(std::size_t n, std::allocator_arg_t, const Alloc &alloc, const Args &...)
+        {
+            return allocator_frames<Alloc>::allocate(n, alloc);
+        }
+
+        static void operator delete(void *frame, std::size_t n) noexcept
+        {
+            get_deleter(frame, n)(frame, n);
+        }
+
+    private:
+        static void release_to_pool(void *frame, std::size_t n) noexcept
+        {
+            frame_pool::local().deallocate(frame, deleter_offset(n) + sizeof(frame_deleter));
+        }
+    };
+
+    // frames from global operator new, for comparison
+    struct default_frames
+    {
+    };
+
+    template <class T>
+    struct promise_result
+    {
+        std::optional<T> value;
+
+        void return_value(T v) { value.emplace(std::move(v)); }
+        T take() { return std::move(*value); }
+    };
+
+    template <>
+    struct promise_result<void>
+    {
+        void return_void() noexcept {}
+        void take() noexcept {}
+    };
+
+    // Lazy task: starts when awaited, resumes its awaiter when done.
+    // A task handed to an executor with spawn() destroys itself at the end.
+    template <class T = void, class Frames = pooled_frames>
+    class task
+    {
+    public:
+        struct promise_type : Frames, promise_result<T>
+        {
+            std::coroutine_handle<> continuation;
+            std::exception_ptr error;
+            bool detached = false;
+
+            task get_return_object() { return task(handle::from_promise(*this)); }
+            std::suspend_always initial_suspend() noexcept { return {}; }
+
+            struct final_awaiter
+            {
+                bool await_ready() noexcept { return false; }
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept
+                {
+                    promise_type &p = h.promise();
+                    if (p.continuation)
+                        return p.continuation;
+                    if (p.detached)
+                    {
+                        if (p.error)
+                            std::terminate(); // nobody left to rethrow it to
+                        h.destroy();
+                    }
+                    return std::noop_coroutine();
+                }
+                void await_resume() noexcept {}
+            };
+
+            final_awaiter final_suspend() noexcept { return {}; }
+            void unhandled_exception() { error = std::current_exception(); }
+        };
+
+        using handle = std::coroutine_handle<promise_type>;
+
+        task(task &&other) noexcept : h_(std::exchange(other.h_, {})) {}
+        task &operator=(task &&other) noexcept
+        {
+            if (this != &other)
+            {
+                if (h_)
+                    h_.destroy();
+                h_ = std::exchange(other.h_, {});
+            }
+            return *this;
+        }
+        ~task()
+        {
+            if (h_)
+                h_.destroy();
+        }
+
+        auto operator co_await() && noexcept
+        {
+            struct awaiter
+            {
+                handle h;
+                bool await_ready() noexcept { return false; }
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept
+                {
+                    h.promise().continuation = caller;
+                    return h;
+                }
+                T await_resume()
+                {
+                    if (h.promise().error)
+                        std::rethrow_exception(h.promise().error);
+                    return h.promise().take();
+                }
+            };
+            return awaiter{h_};
+        }
+
+        // the caller takes over the frame
+        handle release() noexcept { return std::exchange(h_, {}); }
+
+    private:
+        explicit task(handle h) : h_(h) {}
+
+        handle h_;
+    };
+
+    // Pull generator: the body runs up to the next co_yield on every increment.
+    template <class T, class Frames = pooled_frames>
+    class generator
+    {
+    public:
+        struct promise_type : Frames
+        {
+            const T *current = nullptr;
+            std::exception_ptr error;
+
+            generator get_return_object() { return generator(handle::from_promise(*this)); }
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            std::suspend_always final_suspend() noexcept { return {}; }
+            // the yielded temporary lives until the generator is resumed
+            std::suspend_always yield_value(const T &v) noexcept
+            {
+                current = &v;
+                return {};
+            }
+            void return_void() noexcept {}
+            void unhandled_exception() { error = std::current_exception(); }
+        };
+
+        using handle = std::coroutine_handle<promise_type>;
+
+        class iterator
+        {
+        public:
+            using value_type = T;
+            using difference_type = std::ptrdiff_t;
+
+            explicit iterator(handle h = {}) : h_(h) {}
+
+            const T &operator*() const { return *h_.promise().current; }
+            iterator &operator++()
+            {
+                advance(h_);
+                return *this;
+            }
+            void operator++(int) { ++*this; }
+            bool operator==(std::default_sentinel_t) const { return !h_ || h_.done(); }
+
+        private:
+            handle h_;
+        };
+
+        generator(generator &&other) noexcept : h_(std::exchange(other.h_, {})) {}
+        generator &operator=(generator &&) = delete;
+        ~generator()
+        {
+            if (h_)
+                h_.destroy();
+        }
+
+        iterator begin()
+        {
+            advance(h_);
+            return iterator(h_);
+        }
+        std::default_sentinel_t end() const noexcept { return {}; }
+
+    private:
+        explicit generator(handle h) : h_(h) {}
+
+        static void advance(handle h)
+        {
+            h.resume();
+            if (h.promise().error)
+                std::rethrow_exception(h.promise().error);
+        }
+
+        handle h_;
+    };
+
+    // Runs scheduled coroutines one after another on the calling thread.
+    class single_thread_executor
+    {
+    public:
+        auto schedule() noexcept
+        {
+            struct awaiter
+            {
+                single_thread_executor &ex;
+                bool await_ready() noexcept { return false; }
+                void await_suspend(std::coroutine_handle<> h) { ex.ready_.push_back(h); }
+                void await_resume() noexcept {}
+            };
+            return awaiter{*this};
+        }
+
+        // the task runs on the next run() and frees itself when it is done
+        template <class Frames>
+        void spawn(task<void, Frames> &&t)
+        {
+            auto h = t.release();
+            h.promise().detached = true;
+            ready_.push_back(h);
+        }
+
+        // until nothing is left to resume
+        std::size_t run()
+        {
+            std::size_t resumed = 0;
+            while (!ready_.empty())
+            {
+                auto h = ready_.front();
+                ready_.pop_front();
+                h.resume();
+                ++resumed;
+            }
+            return resumed;
+        }
+
+    private:
+        std::deque<std::coroutine_handle<>> ready_;
+    };
+}
+
+template <typename Func>
+auto benchmark(Func test_func, int iterations)
+{
+    const auto start = std::chrono::system_clock::now();
+    while (iterations-- > 0)
+    {
+        test_func();
+    }
+    const auto stop = std::chrono::system_clock::now();
+    const auto secs = std::chrono::duration<double>(stop - start);
+    return secs.count();
+}
+
+// a short request: wait for its turn, call a helper coroutine, record the result
+
+template <class Frames>
+coro::task<int, Frames> lookup(int key)
+{
+    co_return key * 2 + 1;
+}
+
+template <class Frames>
+coro::task<void, Frames> handle_request(coro::single_thread_executor &ex, int key, long &sum)
+{
+    co_await ex.schedule();
+    sum += co_await lookup<Frames>(key);
+}
+
+using pmr_alloc = std::pmr::polymorphic_allocator<std::byte>;
+
+coro::task<int> lookup(std::allocator_arg_t, pmr_alloc, int key)
+{
+    co_return key * 2 + 1;
+}
+
+coro::task<void> handle_request(std::allocator_arg_t, pmr_alloc alloc, coro::single_thread_executor &ex, int key, long &sum)
+{
+    co_await ex.schedule();
+    sum += co_await lookup(std::allocator_arg, alloc, key);
+}
+
+template <class Frames>
+coro::generator<long, Frames> fibonacci()
+{
+    long a = 0, b = 1;
+    for (;;)
+    {
+        co_yield a;
+        b += std::exchange(a, b);
+    }
+}
+
+void test_requests()
+{
+    constexpr int requests{10'000'000};
+    constexpr int batch{1'000};
+    coro::single_thread_executor ex;
+    long sum = 0;
+
+    const double t1 = benchmark([&]
+                                {
+                                    for (int i{}; i != batch; ++i)
+                                    {
+                                        ex.spawn(handle_request<coro::default_frames>(ex, i, sum));
+                                    }
+                                    ex.run(); },
+                                requests / batch);
+
+    const double t2 = benchmark([&]
+                                {
+                                    for (int i{}; i != batch; ++i)
+                                    {
+                                        ex.spawn(handle_request<coro::pooled_frames>(ex, i, sum));
+                                    }
+                                    ex.run(); },
+                                requests / batch);
+
+    std::pmr::unsynchronized_pool_resource resource;
+    const double t3 = benchmark([&]
+                                {
+                                    for (int i{}; i != batch; ++i)
+                                    {
+                                        ex.spawn(handle_request(std::allocator_arg, &resource, ex, i, sum));
+                                    }
+                                    ex.run(); },
+                                requests / batch);
+
+    auto ns = [](double secs, int n)
+    { return secs * 1e9 / n; };
+    std::cout << std::fixed << requests << " requests, each two coroutine frames, a resume and a destroy:\n"
+              << "  t1 (global operator new):     " << t1 << " sec; " << ns(t1, requests) << " ns/request\n"
+              << "  t2 (thread frame pool):       " << t2 << " sec; " << ns(t2, requests) << " ns/request\n"
+              << "  t3 (allocator_arg, pmr pool): " << t3 << " sec; " << ns(t3, requests) << " ns/request\n"
+              << "  checksum: " << sum << '\n';
+}
+
+void test_generator()
+{
+    constexpr int iterations{1'000'000};
+    long sum = 0;
+    auto take = [&sum](auto gen)
+    {
+        int n = 0;
+        for (long v : gen)
+        {
+            sum += v;
+            if (++n == 8)
+                break;
+        }
+    };
+
+    const double t1 = benchmark([&]
+                                { take(fibonacci<coro::default_frames>()); },
+                                iterations);
+    const double t2 = benchmark([&]
+                                { take(fibonacci<coro::pooled_frames>()); },
+                                iterations);
+
+    std::cout << std::fixed << iterations << " generators, 8 values each:\n"
+              << "  t1 (global operator new): " << t1 << " sec\n"
+              << "  t2 (thread frame pool):   " << t2 << " sec\n"
+              << "  checksum: " << sum << '\n';
+}
+
+int main()
+{
+    test_requests();
+    test_generator();
+
+    return 0;
+}
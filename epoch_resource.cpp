@@ -0,0 +1,350 @@
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <iostream>
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+// Monotonic allocation split into epochs.
+// Every allocation lands in the current epoch's chunks, deallocate is a no-op.
+// Readers pin the epoch they started in; an epoch older than every pinned one
+// is released at once by splicing its chunk list onto a recycle list, so the
+// upstream is only asked for new chunks when the working set really grows.
+// Allocation, pin() and advance() belong to one thread; a guard may be
+// handed to another thread and dropped there.
+class epoch_resource : public std::pmr::memory_resource
+{
+    struct chunk
+    {
+        chunk *next;
+        std::size_t size;  // bytes requested from upstream
+        std::size_t align; // alignment requested from upstream
+    };
+
+    struct epoch
+    {
+        explicit epoch(std::uint64_t i) : id(i) {}
+
+        std::uint64_t id;
+        std::atomic<long> pins{0};
+        chunk *head = nullptr; // regular chunks, recycled on release
+        chunk *tail = nullptr;
+        chunk *large = nullptr; // oversized blocks, returned upstream on release
+    };
+
+public:
+    // keeps the epoch it was taken in (and every later one) alive
+    class guard
+    {
+    public:
+        explicit guard(epoch *e) noexcept : e_(e) {}
+        guard(guard &&other) noexcept : e_(other.e_) { other.e_ = nullptr; }
+        guard(const guard &) = delete;
+        guard &operator=(const guard &) = delete;
+        ~guard()
+        {
+            if (e_)
+                e_->pins.fetch_sub(1, std::memory_order_release);
+        }
+
+        std::uint64_t id() const noexcept { return e_->id; }
+
+    private:
+        epoch *e_;
+    };
+
+    explicit epoch_resource(std::size_t chunk_size = 64 * 1024,
+                            std::pmr::memory_resource *upstream = std::pmr::get_default_resource())
+        : chunk_size_(chunk_size), upstream_(upstream)
+    {
+        epochs_.emplace_back(0);
+    }
+
+    epoch_resource(const epoch_resource &) = delete;
+    epoch_resource &operator=(const epoch_resource &) = delete;
+
+    ~epoch_resource() override
+    {
+        for (auto &e : epochs_)
+        {
+            release_list(e.head);
+            release_list(e.large);
+        }
+        release_list(free_chunks_);
+    }
+
+    guard pin()
+    {
+        epoch &e = epochs_.back();
+        e.pins.fetch_add(1, std::memory_order_relaxed);
+        return guard(&e);
+    }
+
+    std::uint64_t current_epoch() const { return epochs_.back().id; }
+
+    // opens a new epoch and releases the old ones nobody pins any more
+    void advance()
+    {
+        epochs_.emplace_back(epochs_.back().id + 1);
+        cur_ = end_ = nullptr;
+        reclaim();
+    }
+
+    // O(1) per epoch for regular chunks, returns the number of released epochs
+    std::size_t reclaim()
+    {
+        std::size_t released = 0;
+        while (epochs_.size() > 1 && epochs_.front().pins.load(std::memory_order_acquire) == 0)
+        {
+            epoch &e = epochs_.front();
+            if (e.head)
+            {
+                e.tail->next = free_chunks_;
+                free_chunks_ = e.head;
+            }
+            release_list(e.large);
+            epochs_.pop_front();
+            ++released;
+        }
+        return released;
+    }
+
+    std::size_t live_epochs() const { return epochs_.size(); }
+    std::size_t upstream_bytes() const { return upstream_bytes_; }
+
+private:
+    static std::size_t align_up(std::size_t n, std::size_t align)
+    {
+        return (n + align - 1) & ~(align - 1);
+    }
+
+    static char *align_up(char *p, std::size_t align)
+    {
+        return reinterpret_cast<char *>(align_up(reinterpret_cast<std::uintptr_t>(p), align));
+    }
+
+    chunk *upstream_chunk(std::size_t size, std::size_t align)
+    {
+        align = align < alignof(chunk) ? alignof(chunk) : align;
+        auto *c = static_cast<chunk *>(upstream_->allocate(size, align));
+        c->next = nullptr;
+        c->size = size;
+        c->align = align;
+        upstream_bytes_ += size;
+        return c;
+    }
+
+    void release_list(chunk *c)
+    {
+        while (c)
+        {
+            chunk *next = c->next;
+            upstream_bytes_ -= c->size;
+            upstream_->deallocate(c, c->size, c->align);
+            c = next;
+        }
+    }
+
+    void *do_allocate(std::size_t bytes, std::size_t align) override
+    {
+        char *p = align_up(cur_, align);
+        if (cur_ && p + bytes <= end_)
+        {
+            cur_ = p + bytes;
+            return p;
+        }
+
+        epoch &e = epochs_.back();
+        const std::size_t header = align_up(sizeof(chunk), align);
+        if (bytes > chunk_size_ / 4)
+        {
+            chunk *c = upstream_chunk(header + bytes, align);
+            c->next = e.large;
+            e.large = c;
+            return reinterpret_cast<char *>(c) + header;
+        }
+
+        chunk *c = free_chunks_;
+        if (c)
+            free_chunks_ = c->next;
+        else
+            c = upstream_chunk(chunk_size_, alignof(std::max_align_t));
+        c->next = nullptr;
+        if (e.tail)
+            e.tail->next = c;
+        else
+            e.head = c;
+        e.tail = c;
+
+        cur_ = align_up(reinterpret_cast<char *>(c) + sizeof(chunk), align);
+        end_ = reinterpret_cast<char *>(c) + chunk_size_;
+        p = cur_;
+        cur_ += bytes;
+        return p;
+    }
+
+    void do_deallocate(void *, std::size_t, std::size_t) override
+    {
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+    {
+        return this == &other;
+    }
+
+    std::size_t chunk_size_;
+    std::pmr::memory_resource *upstream_;
+    std::deque<epoch> epochs_; // front is the oldest, back is the current one
+    chunk *free_chunks_ = nullptr;
+    char *cur_ = nullptr;
+    char *end_ = nullptr;
+    std::size_t upstream_bytes_ = 0;
+};
+
+// upstream that remembers how much memory it handed out
+class counting_resource : public std::pmr::memory_resource
+{
+public:
+    std::size_t bytes() const { return bytes_; }
+    std::size_t peak() const { return peak_; }
+    std::size_t calls() const { return calls_; }
+
+private:
+    void *do_allocate(std::size_t bytes, std::size_t align) override
+    {
+        bytes_ += bytes;
+        peak_ = bytes_ > peak_ ? bytes_ : peak_;
+        ++calls_;
+        return std::pmr::new_delete_resource()->allocate(bytes, align);
+    }
+
+    void do_deallocate(void *p, std::size_t bytes, std::size_t align) override
+    {
+        bytes_ -= bytes;
+        std::pmr::new_delete_resource()->deallocate(p, bytes, align);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+    {
+        return this == &other;
+    }
+
+    std::size_t bytes_ = 0;
+    std::size_t peak_ = 0;
+    std::size_t calls_ = 0;
+};
+
+template <typename Func>
+auto benchmark(Func test_func, int iterations)
+{
+    const auto start = std::chrono::system_clock::now();
+    while (iterations-- > 0)
+    {
+        test_func();
+    }
+    const auto stop = std::chrono::system_clock::now();
+    const auto secs = std::chrono::duration<double>(stop - start);
+    return secs.count();
+}
+
+constexpr int total_requests{1'000'000};
+constexpr int strings_per_request{16};
+constexpr int requests_per_epoch{1'000};
+
+// one request: a handful of keys that do not fit into the SSO buffer
+std::size_t handle_request(std::pmr::memory_resource *res, int id)
+{
+    std::pmr::vector<std::pmr::string> fields{res};
+    char buf[32];
+    for (int i{}; i != strings_per_request; ++i)
+    {
+        std::snprintf(buf, sizeof(buf), "request-field-%d", id + i);
+        fields.emplace_back(buf);
+    }
+    std::size_t total = 0;
+    for (const auto &f : fields)
+    {
+        total += f.size();
+    }
+    return total;
+}
+
+void report(const char *name, double secs, const counting_resource &upstream)
+{
+    std::cout << std::fixed << name << secs << " sec; "
+              << static_cast<long>(total_requests / secs) << " req/s; "
+              << "upstream peak = " << (upstream.peak() >> 10) << " kB; "
+              << "upstream held = " << (upstream.bytes() >> 10) << " kB; "
+              << "upstream calls = " << upstream.calls() << '\n';
+}
+
+int main()
+{
+    std::size_t checksum = 0;
+
+    {
+        counting_resource upstream;
+        int id = 0;
+        const double t = benchmark([&]
+                                   { checksum += handle_request(&upstream, id++); },
+                                   total_requests);
+        report("t1 (new_delete): ", t, upstream);
+    }
+
+    {
+        counting_resource upstream;
+        std::pmr::unsynchronized_pool_resource pool{&upstream};
+        int id = 0;
+        const double t = benchmark([&]
+                                   { checksum += handle_request(&pool, id++); },
+                                   total_requests);
+        report("t2 (unsync pool): ", t, upstream);
+    }
+
+    {
+        // the fastest option, but nothing is given back while the service runs
+        counting_resource upstream;
+        std::pmr::monotonic_buffer_resource mbr{&upstream};
+        int id = 0;
+        const double t = benchmark([&]
+                                   { checksum += handle_request(&mbr, id++); },
+                                   total_requests);
+        report("t3 (monotonic): ", t, upstream);
+    }
+
+    {
+        counting_resource upstream;
+        epoch_resource epochs{64 * 1024, &upstream};
+        int id = 0;
+        const double t = benchmark([&]
+                                   {
+                                       auto g = epochs.pin();
+                                       checksum += handle_request(&epochs, id);
+                                       if (++id % requests_per_epoch == 0)
+                                           epochs.advance(); },
+                                   total_requests);
+        report("t4 (epoch): ", t, upstream);
+    }
+
+    {
+        // a long reader holds its epoch, so nothing after it may be released
+        epoch_resource epochs;
+        auto reader = epochs.pin();
+        std::pmr::vector<std::pmr::string> kept{&epochs};
+        kept.emplace_back("held by a slow reader, must survive advance()");
+        for (int i{}; i != 3; ++i)
+        {
+            handle_request(&epochs, i);
+            epochs.advance();
+        }
+        std::cout << "live epochs while pinned: " << epochs.live_epochs()
+                  << ", kept = " << kept.front() << '\n';
+    }
+
+    std::cout << "checksum: " << checksum << std::endl;
+    return 0;
+}
@@ -0,0 +1,391 @@
+#include "my_pool_alloc.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <list>
+#include <map>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <vector>
+
+// what a guard found and where; the handler decides whether to keep going
+enum class guard_error
+{
+    double_free,
+    unknown_pointer,
+    size_mismatch,
+    underflow,
+    overflow,
+    use_after_free,
+};
+
+inline const char *to_string(guard_error e)
+{
+    switch (e)
+    {
+    case guard_error::double_free:
+        return "double free";
+    case guard_error::unknown_pointer:
+        return "free of a pointer that was not allocated here";
+    case guard_error::size_mismatch:
+        return "deallocate size differs from allocate size";
+    case guard_error::underflow:
+        return "front redzone overwritten";
+    case guard_error::overflow:
+        return "rear redzone overwritten";
+    case guard_error::use_after_free:
+        return "write to freed memory";
+    }
+    return "?";
+}
+
+// default: report and abort, the process state can not be trusted any more
+inline void abort_on_violation(guard_error e, const void *p, std::size_t n)
+{
+    std::cerr << "guarded_alloc: " << to_string(e) << " at " << p << " [n = " << n << "]" << std::endl;
+    std::abort();
+}
+
+inline void (*guard_violation_handler)(guard_error, const void *, std::size_t) = abort_on_violation;
+
+// flush functions of the quarantine rings this thread has used, one per guarded type
+inline std::vector<void (*)()> &guard_rings()
+{
+    thread_local std::vector<void (*)()> rings;
+    return rings;
+}
+
+// hand every quarantined block of this thread back to its allocator;
+// call it before destroying a pool or resource that guarded allocators use
+inline void flush_guard_quarantine()
+{
+    for (auto flush : guard_rings())
+    {
+        flush();
+    }
+}
+
+// Allocator adaptor for catching memory bugs on a fraction of hosts.
+// Every block gets an 8-byte header with its element count and a live/freed
+// mark, a canary right before and right after the user bytes, and on free its
+// head is poisoned and the block parked in a quarantine ring before the
+// inner allocator may reuse it.
+// The ring is per thread and per inner allocator type, so creating a
+// container costs nothing extra. Freed blocks wait there together with a
+// copy of their allocator: call flush_guard_quarantine() before the pool or
+// resource behind a stateful inner allocator is destroyed.
+template <class Alloc>
+struct guarded_alloc
+{
+    using inner_traits = std::allocator_traits<Alloc>;
+    using value_type = typename inner_traits::value_type;
+    using T = value_type;
+
+    static constexpr std::size_t quarantine_size = 256;
+    static constexpr std::uint32_t live_mark = 0xA110C8EDu;
+    static constexpr std::uint32_t freed_mark = 0xF4EEF4EEu;
+    static constexpr std::uint64_t canary = 0xCAFEF00DDEADBEEFull;
+    static constexpr unsigned char poison = 0xDD;
+    // only the head of a freed block is poisoned and checked, stale writes
+    // through a dangling pointer almost always hit the first fields
+    static constexpr std::size_t poison_bytes = 64;
+
+    template <typename U>
+    struct rebind
+    {
+        using other = guarded_alloc<typename inner_traits::template rebind_alloc<U>>;
+    };
+
+    using propagate_on_container_copy_assignment = typename inner_traits::propagate_on_container_copy_assignment;
+    using propagate_on_container_move_assignment = typename inner_traits::propagate_on_container_move_assignment;
+    using propagate_on_container_swap = typename inner_traits::propagate_on_container_swap;
+
+    guarded_alloc() = default;
+
+    explicit guarded_alloc(const Alloc &inner) : inner_(inner) {}
+
+    template <typename A>
+    guarded_alloc(const guarded_alloc<A> &other) : inner_(other.inner()) {}
+
+    T *allocate(std::size_t n)
+    {
+        T *base = inner_traits::allocate(inner_, total_units(n));
+        auto *raw = reinterpret_cast<unsigned char *>(base);
+
+        const header h{live_mark, static_cast<std::uint32_t>(n)};
+        std::memcpy(raw, &h, sizeof(h));
+        std::memcpy(raw + header_bytes - sizeof(canary), &canary, sizeof(canary));
+        std::memcpy(raw + header_bytes + n * sizeof(T), &canary, sizeof(canary));
+        return reinterpret_cast<T *>(raw + header_bytes);
+    }
+
+    void deallocate(T *p, std::size_t n)
+    {
+        if (!p)
+            return;
+        auto *raw = reinterpret_cast<unsigned char *>(p) - header_bytes;
+
+        header h;
+        std::memcpy(&h, raw, sizeof(h));
+        if (h.mark == freed_mark)
+            return report(guard_error::double_free, p, n);
+        if (h.mark != live_mark)
+            return report(guard_error::unknown_pointer, p, n);
+        if (h.n != static_cast<std::uint32_t>(n))
+            return report(guard_error::size_mismatch, p, n);
+
+        std::uint64_t front, rear;
+        std::memcpy(&front, raw + header_bytes - sizeof(canary), sizeof(front));
+        std::memcpy(&rear, raw + header_bytes + n * sizeof(T), sizeof(rear));
+        if (front != canary)
+            report(guard_error::underflow, p, n);
+        if (rear != canary)
+            report(guard_error::overflow, p, n);
+
+        h.mark = freed_mark;
+        std::memcpy(raw, &h, sizeof(h));
+        std::memset(raw + header_bytes, poison, poisoned(n));
+
+        quarantine &q = ring();
+        quarantined &slot = q.slots[q.next];
+        if (slot.raw)
+            release(slot);
+        slot.raw = raw;
+        slot.n = n;
+        slot.inner.emplace(inner_);
+        q.next = (q.next + 1) % quarantine_size;
+    }
+
+    static void flush()
+    {
+        for (auto &slot : ring().slots)
+        {
+            if (slot.raw)
+                release(slot);
+        }
+    }
+
+    const Alloc &inner() const { return inner_; }
+
+    template <class A>
+    bool operator==(const guarded_alloc<A> &other) const { return inner_ == other.inner(); }
+    template <class A>
+    bool operator!=(const guarded_alloc<A> &other) const { return !(*this == other); }
+
+private:
+    // 32 bits of the count are enough to catch a mismatch and keep a list
+    // node of three pointers within two units
+    struct header
+    {
+        std::uint32_t mark;
+        std::uint32_t n;
+    };
+
+    struct quarantined
+    {
+        unsigned char *raw = nullptr;
+        std::size_t n = 0;
+        std::optional<Alloc> inner; // polymorphic_allocator can not be assigned
+    };
+
+    struct quarantine
+    {
+        quarantine() { guard_rings().push_back(flush); }
+        ~quarantine() { flush(); }
+
+        quarantined slots[quarantine_size];
+        std::size_t next = 0;
+    };
+
+    static quarantine &ring()
+    {
+        thread_local quarantine q;
+        return q;
+    }
+
+    // header plus front canary, rounded so the user block keeps T's alignment
+    static constexpr std::size_t header_bytes =
+        ((sizeof(header) + sizeof(canary) + alignof(T) - 1) / alignof(T)) * alignof(T);
+
+    static std::size_t total_units(std::size_t n)
+    {
+        return (header_bytes + n * sizeof(T) + sizeof(canary) + sizeof(T) - 1) / sizeof(T);
+    }
+
+    static std::size_t poisoned(std::size_t n)
+    {
+        return std::min(n * sizeof(T), poison_bytes);
+    }
+
+    static void report(guard_error e, const void *p, std::size_t n)
+    {
+        guard_violation_handler(e, p, n);
+    }
+
+    // a write after free shows up as a broken poison pattern on eviction
+    static void release(quarantined &slot)
+    {
+        static const auto pattern = []
+        {
+            std::array<unsigned char, poison_bytes> bytes;
+            bytes.fill(poison);
+            return bytes;
+        }();
+        const unsigned char *user = slot.raw + header_bytes;
+        if (std::memcmp(user, pattern.data(), poisoned(slot.n)) != 0)
+            report(guard_error::use_after_free, user, slot.n);
+        inner_traits::deallocate(*slot.inner, reinterpret_cast<T *>(slot.raw), total_units(slot.n));
+        slot.raw = nullptr;
+        slot.inner.reset();
+    }
+
+    Alloc inner_;
+};
+
+template <typename Func>
+auto benchmark(Func test_func, int iterations)
+{
+    const auto start = std::chrono::system_clock::now();
+    while (iterations-- > 0)
+    {
+        test_func();
+    }
+    const auto stop = std::chrono::system_clock::now();
+    const auto secs = std::chrono::duration<double>(stop - start);
+    return secs.count();
+}
+
+int violations = 0;
+
+void count_violation(guard_error e, const void *p, std::size_t n)
+{
+    ++violations;
+    std::cout << "  caught: " << to_string(e) << " [n = " << n << "]" << (p ? "" : " (null)") << std::endl;
+}
+
+// the bug classes from the examples, each caught by the guard
+void show_detection()
+{
+    guard_violation_handler = count_violation;
+
+    std::cout << "my_vector operator[] accepts pos == size:" << std::endl;
+    {
+        Pool pool(sizeof(int));
+        using alloc = guarded_alloc<my_pool_alloc<int>>;
+        my_vector<int, alloc> v{alloc(my_pool_alloc<int>(pool))};
+        for (int i = 0; i < 7; ++i)
+        {
+            v.push_back(i); // capacity grows 1, 3, 7
+        }
+        v[7] = 42; // one past the end, lands on the rear canary
+        v = my_vector<int, alloc>(alloc(my_pool_alloc<int>(pool)));
+        flush_guard_quarantine(); // before the pool goes away
+    }
+
+    guarded_alloc<std::allocator<long>> a;
+    std::cout << "double free:" << std::endl;
+    long *p = a.allocate(4);
+    a.deallocate(p, 4);
+    a.deallocate(p, 4);
+
+    std::cout << "deallocate with the wrong count:" << std::endl;
+    long *q = a.allocate(4);
+    a.deallocate(q, 3);
+    a.deallocate(q, 4);
+
+    std::cout << "write after free (found when it leaves the quarantine):" << std::endl;
+    long *r = a.allocate(2);
+    a.deallocate(r, 2);
+    r[1] = 7;
+    for (std::size_t i = 0; i < guarded_alloc<std::allocator<long>>::quarantine_size; ++i)
+    {
+        a.deallocate(a.allocate(1), 1);
+    }
+
+    std::cout << "violations caught: " << violations << std::endl;
+    guard_violation_handler = abort_on_violation;
+}
+
+template <template <class> class Alloc>
+double list_workload(int iterations)
+{
+    return benchmark([]
+                     {
+                         std::list<int, Alloc<int>> list;
+                         for (int i{}; i != 200'000; ++i)
+                         {
+                             list.push_back(i);
+                         } },
+                     iterations);
+}
+
+template <template <class> class Alloc>
+double map_workload(int iterations)
+{
+    return benchmark([]
+                     {
+                         std::map<int, int, std::less<int>, Alloc<std::pair<const int, int>>> m;
+                         for (int i{}; i != 100'000; ++i)
+                         {
+                             m.emplace((i * 7919) % 100'003, i);
+                         } },
+                     iterations);
+}
+
+template <template <class> class Alloc>
+double vector_workload(int iterations)
+{
+    return benchmark([]
+                     {
+                         for (int n{}; n != 10'000; ++n)
+                         {
+                             std::vector<int, Alloc<int>> v;
+                             for (int i{}; i != 200; ++i)
+                             {
+                                 v.push_back(i);
+                             }
+                         } },
+                     iterations);
+}
+
+template <class T>
+using plain = std::allocator<T>;
+template <class T>
+using guarded = guarded_alloc<std::allocator<T>>;
+template <class T>
+using plain_pmr = std::pmr::polymorphic_allocator<T>;
+template <class T>
+using guarded_pmr = guarded_alloc<std::pmr::polymorphic_allocator<T>>;
+
+void report(const char *name, double plain_secs, double guarded_secs)
+{
+    std::cout << std::fixed << name << plain_secs << " sec -> " << guarded_secs
+              << " sec guarded (x" << guarded_secs / plain_secs << ")" << '\n';
+}
+
+int main()
+{
+    show_detection();
+
+    constexpr int iterations{20};
+    report("list push_back, std::allocator:  ", list_workload<plain>(iterations), list_workload<guarded>(iterations));
+    report("map emplace, std::allocator:     ", map_workload<plain>(iterations), map_workload<guarded>(iterations));
+    report("vector growth, std::allocator:   ", vector_workload<plain>(iterations), vector_workload<guarded>(iterations));
+
+    // the default resource becomes a pool, both variants draw from it
+    std::pmr::unsynchronized_pool_resource pool;
+    std::pmr::set_default_resource(&pool);
+    report("list push_back, pmr pool:        ", list_workload<plain_pmr>(iterations), list_workload<guarded_pmr>(iterations));
+    report("map emplace, pmr pool:           ", map_workload<plain_pmr>(iterations), map_workload<guarded_pmr>(iterations));
+    report("vector growth, pmr pool:         ", vector_workload<plain_pmr>(iterations), vector_workload<guarded_pmr>(iterations));
+    flush_guard_quarantine();
+    std::pmr::set_default_resource(nullptr);
+
+    return 0;
+}
@@ -0,0 +1,674 @@
+#include "my_pool_alloc.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <memory_resource>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// std::hash<int> is the identity, spread the bits before taking buckets or H1/H2
+inline std::size_t mix_hash(std::size_t h)
+{
+    const unsigned __int128 m = static_cast<unsigned __int128>(h) * 0x9E3779B97F4A7C15ull;
+    return static_cast<std::size_t>(m) ^ static_cast<std::size_t>(m >> 64);
+}
+
+// Separate chaining, one allocation per node, nodes never move.
+// The bucket array is carved from node-sized units of the same allocator,
+// so a fixed-chunk pool (my_pool_alloc over a Pool of node_size) serves both.
+template <class K, class V, class Hash = std::hash<K>, class Eq = std::equal_to<K>,
+          class Alloc = std::allocator<std::pair<const K, V>>>
+class node_hash_map
+{
+public:
+    using value_type = std::pair<const K, V>;
+
+private:
+    struct node
+    {
+        node *next;
+        std::size_t hash;
+        value_type value;
+    };
+
+    using node_alloc = typename std::allocator_traits<Alloc>::template rebind_alloc<node>;
+    using node_traits = std::allocator_traits<node_alloc>;
+
+public:
+    static constexpr std::size_t node_size = sizeof(node);
+
+    class iterator
+    {
+    public:
+        value_type &operator*() const { return n_->value; }
+        value_type *operator->() const { return &n_->value; }
+        iterator &operator++()
+        {
+            n_ = n_->next;
+            while (!n_ && ++bucket_ != map_->bucket_count_)
+            {
+                n_ = map_->buckets_[bucket_];
+            }
+            return *this;
+        }
+        bool operator==(const iterator &o) const { return n_ == o.n_; }
+        bool operator!=(const iterator &o) const { return n_ != o.n_; }
+
+    private:
+        friend class node_hash_map;
+        iterator(const node_hash_map *m, std::size_t b, node *n) : map_(m), bucket_(b), n_(n) {}
+
+        const node_hash_map *map_;
+        std::size_t bucket_;
+        node *n_;
+    };
+
+    explicit node_hash_map(const Alloc &alloc = Alloc()) : alloc_(alloc) {}
+
+    node_hash_map(const node_hash_map &) = delete;
+    node_hash_map &operator=(const node_hash_map &) = delete;
+
+    ~node_hash_map()
+    {
+        clear();
+        free_buckets(buckets_, bucket_count_);
+    }
+
+    std::size_t size() const { return size_; }
+    std::size_t bucket_count() const { return bucket_count_; }
+
+    iterator begin() const
+    {
+        for (std::size_t b = 0; b < bucket_count_; ++b)
+        {
+            if (buckets_[b])
+                return iterator(this, b, buckets_[b]);
+        }
+        return end();
+    }
+    iterator end() const { return iterator(this, bucket_count_, nullptr); }
+
+    value_type *find(const K &key) const
+    {
+        if (!size_)
+            return nullptr;
+        return find(key, mix_hash(hash_(key)));
+    }
+
+    template <class... Args>
+    std::pair<value_type *, bool> try_emplace(const K &key, Args &&...args)
+    {
+        const std::size_t h = mix_hash(hash_(key));
+        if (size_)
+        {
+            if (value_type *v = find(key, h))
+                return {v, false};
+        }
+        if (size_ + 1 > bucket_count_)
+            rehash(bucket_count_ ? bucket_count_ * 2 : 16);
+
+        node *n = node_traits::allocate(alloc_, 1);
+        try
+        {
+            node_traits::construct(alloc_, &n->value, std::piecewise_construct,
+                                   std::forward_as_tuple(key), std::forward_as_tuple(std::forward<Args>(args)...));
+        }
+        catch (...)
+        {
+            node_traits::deallocate(alloc_, n, 1);
+            throw;
+        }
+        n->hash = h;
+        node *&head = buckets_[h & (bucket_count_ - 1)];
+        n->next = head;
+        head = n;
+        ++size_;
+        return {&n->value, true};
+    }
+
+    bool insert(const value_type &v) { return try_emplace(v.first, v.second).second; }
+
+    V &operator[](const K &key) { return try_emplace(key).first->second; }
+
+    bool erase(const K &key)
+    {
+        if (!size_)
+            return false;
+        const std::size_t h = mix_hash(hash_(key));
+        for (node **link = &buckets_[h & (bucket_count_ - 1)]; *link; link = &(*link)->next)
+        {
+            node *n = *link;
+            if (n->hash == h && eq_(n->value.first, key))
+            {
+                *link = n->next;
+                destroy(n);
+                --size_;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void clear()
+    {
+        for (std::size_t b = 0; b < bucket_count_; ++b)
+        {
+            for (node *n = buckets_[b]; n;)
+            {
+                node *next = n->next;
+                destroy(n);
+                n = next;
+            }
+            buckets_[b] = nullptr;
+        }
+        size_ = 0;
+    }
+
+    void rehash(std::size_t count)
+    {
+        node **fresh = alloc_buckets(count);
+        for (std::size_t b = 0; b < bucket_count_; ++b)
+        {
+            for (node *n = buckets_[b]; n;)
+            {
+                node *next = n->next;
+                node *&head = fresh[n->hash & (count - 1)];
+                n->next = head;
+                head = n;
+                n = next;
+            }
+        }
+        free_buckets(buckets_, bucket_count_);
+        buckets_ = fresh;
+        bucket_count_ = count;
+    }
+
+private:
+    // h is mix_hash(hash_(key)); needs at least one bucket
+    value_type *find(const K &key, std::size_t h) const
+    {
+        for (node *n = buckets_[h & (bucket_count_ - 1)]; n; n = n->next)
+        {
+            if (n->hash == h && eq_(n->value.first, key))
+                return &n->value;
+        }
+        return nullptr;
+    }
+
+    static std::size_t bucket_units(std::size_t count)
+    {
+        return (count * sizeof(node *) + sizeof(node) - 1) / sizeof(node);
+    }
+
+    node **alloc_buckets(std::size_t count)
+    {
+        node **b = reinterpret_cast<node **>(node_traits::allocate(alloc_, bucket_units(count)));
+        std::fill(b, b + count, nullptr);
+        return b;
+    }
+
+    void free_buckets(node **b, std::size_t count)
+    {
+        if (b)
+            node_traits::deallocate(alloc_, reinterpret_cast<node *>(b), bucket_units(count));
+    }
+
+    void destroy(node *n)
+    {
+        node_traits::destroy(alloc_, &n->value);
+        node_traits::deallocate(alloc_, n, 1);
+    }
+
+    node_alloc alloc_;
+    Hash hash_;
+    Eq eq_;
+    node **buckets_ = nullptr;
+    std::size_t bucket_count_ = 0; // zero or a power of two
+    std::size_t size_ = 0;
+};
+
+// Control bytes for the open-addressing map: a full slot keeps the low 7 bits
+// of its hash (H2), the special values have the sign bit set.
+namespace swiss
+{
+    using ctrl_t = std::int8_t;
+    constexpr ctrl_t empty = -128;  // 0b10000000
+    constexpr ctrl_t deleted = -2;  // 0b11111110
+    constexpr ctrl_t sentinel = -1; // 0b11111111, never stored, only compared against
+
+    inline int lowest_bit(std::uint64_t m) { return __builtin_ctzll(m); }
+
+#if defined(__SSE2__)
+    // 16 control bytes at a time, one mask bit per slot
+    struct group
+    {
+        static constexpr std::size_t width = 16;
+        static constexpr int shift = 0;
+
+        explicit group(const ctrl_t *p) : ctrl(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p))) {}
+
+        std::uint64_t match(ctrl_t h2) const
+        {
+            return static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), ctrl)));
+        }
+        std::uint64_t match_empty() const { return match(empty); }
+        std::uint64_t match_empty_or_deleted() const
+        {
+            return static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(sentinel), ctrl)));
+        }
+
+        __m128i ctrl;
+    };
+#else
+    // portable fallback: 8 control bytes in a word, one mask bit per byte (bit 7)
+    struct group
+    {
+        static constexpr std::size_t width = 8;
+        static constexpr int shift = 3;
+        static constexpr std::uint64_t lsbs = 0x0101010101010101ull;
+        static constexpr std::uint64_t msbs = 0x8080808080808080ull;
+
+        explicit group(const ctrl_t *p) { std::memcpy(&ctrl, p, sizeof(ctrl)); }
+
+        // may report false positives, the caller compares keys anyway
+        std::uint64_t match(ctrl_t h2) const
+        {
+            const std::uint64_t x = ctrl ^ (lsbs * static_cast<std::uint8_t>(h2));
+            return (x - lsbs) & ~x & msbs;
+        }
+        std::uint64_t match_empty() const { return (ctrl & ~(ctrl << 6)) & msbs; }
+        std::uint64_t match_empty_or_deleted() const { return (ctrl & ~(ctrl << 7)) & msbs; }
+
+        std::uint64_t ctrl;
+    };
+#endif
+}
+
+// Open addressing with SwissTable-style group probing.
+// Slots and control bytes live in one allocation made in units of value_type,
+// the first group of control bytes is mirrored after the last slot so that a
+// group can be loaded at any slot index.
+template <class K, class V, class Hash = std::hash<K>, class Eq = std::equal_to<K>,
+          class Alloc = std::allocator<std::pair<const K, V>>>
+class flat_hash_map
+{
+    using group = swiss::group;
+    using ctrl_t = swiss::ctrl_t;
+
+public:
+    using value_type = std::pair<const K, V>;
+
+private:
+    using slot_alloc = typename std::allocator_traits<Alloc>::template rebind_alloc<value_type>;
+    using slot_traits = std::allocator_traits<slot_alloc>;
+
+public:
+    class iterator
+    {
+    public:
+        value_type &operator*() const { return map_->slots_[i_]; }
+        value_type *operator->() const { return &map_->slots_[i_]; }
+        iterator &operator++()
+        {
+            ++i_;
+            skip();
+            return *this;
+        }
+        bool operator==(const iterator &o) const { return i_ == o.i_; }
+        bool operator!=(const iterator &o) const { return i_ != o.i_; }
+
+    private:
+        friend class flat_hash_map;
+        iterator(const flat_hash_map *m, std::size_t i) : map_(m), i_(i) { skip(); }
+        void skip()
+        {
+            while (i_ < map_->capacity_ && map_->ctrl_[i_] < 0)
+            {
+                ++i_;
+            }
+        }
+
+        const flat_hash_map *map_;
+        std::size_t i_;
+    };
+
+    explicit flat_hash_map(const Alloc &alloc = Alloc()) : alloc_(alloc) {}
+
+    flat_hash_map(const flat_hash_map &) = delete;
+    flat_hash_map &operator=(const flat_hash_map &) = delete;
+
+    ~flat_hash_map()
+    {
+        destroy_slots();
+        free_storage(slots_, capacity_);
+    }
+
+    std::size_t size() const { return size_; }
+    std::size_t capacity() const { return capacity_; }
+
+    iterator begin() const { return iterator(this, 0); }
+    iterator end() const { return iterator(this, capacity_); }
+
+    value_type *find(const K &key) const
+    {
+        if (!capacity_)
+            return nullptr;
+        return find(key, mix_hash(hash_(key)));
+    }
+
+    template <class... Args>
+    std::pair<value_type *, bool> try_emplace(const K &key, Args &&...args)
+    {
+        const std::size_t h = mix_hash(hash_(key));
+        if (capacity_)
+        {
+            if (value_type *v = find(key, h))
+                return {v, false};
+        }
+        if ((size_ + deleted_ + 1) * 8 > capacity_ * 7)
+        {
+            // mostly tombstones: clean up in place instead of growing
+            const bool grow = (size_ * 2 + 1) * 8 > capacity_ * 7;
+            rehash(grow ? capacity_ * 2 : capacity_);
+        }
+
+        // the table changes only once the value exists, a throwing one leaves it as it was
+        const std::size_t i = find_free(h);
+        slot_traits::construct(alloc_, &slots_[i], std::piecewise_construct,
+                               std::forward_as_tuple(key), std::forward_as_tuple(std::forward<Args>(args)...));
+        if (ctrl_[i] == swiss::deleted)
+            --deleted_;
+        set_ctrl(i, static_cast<ctrl_t>(h & 0x7F));
+        ++size_;
+        return {&slots_[i], true};
+    }
+
+    bool insert(const value_type &v) { return try_emplace(v.first, v.second).second; }
+
+    V &operator[](const K &key) { return try_emplace(key).first->second; }
+
+    bool erase(const K &key)
+    {
+        value_type *v = find(key);
+        if (!v)
+            return false;
+        const std::size_t i = static_cast<std::size_t>(v - slots_);
+        slot_traits::destroy(alloc_, v);
+        set_ctrl(i, swiss::deleted);
+        --size_;
+        ++deleted_;
+        return true;
+    }
+
+    void rehash(std::size_t count)
+    {
+        count = std::max<std::size_t>(count, group::width);
+        value_type *old_slots = slots_;
+        ctrl_t *old_ctrl = ctrl_;
+        const std::size_t old_capacity = capacity_;
+
+        allocate_storage(count);
+        for (std::size_t i = 0; i < old_capacity; ++i)
+        {
+            if (old_ctrl[i] < 0)
+                continue;
+            const std::size_t h = mix_hash(hash_(old_slots[i].first));
+            const std::size_t j = find_free(h);
+            slot_traits::construct(alloc_, &slots_[j], std::move(old_slots[i]));
+            slot_traits::destroy(alloc_, &old_slots[i]);
+            set_ctrl(j, static_cast<ctrl_t>(h & 0x7F));
+        }
+        deleted_ = 0;
+        free_storage(old_slots, old_capacity);
+    }
+
+private:
+    std::size_t mask() const { return capacity_ - 1; }
+
+    // h is mix_hash(hash_(key)); needs storage
+    value_type *find(const K &key, std::size_t h) const
+    {
+        const auto h2 = static_cast<ctrl_t>(h & 0x7F);
+        std::size_t pos = (h >> 7) & mask();
+        for (std::size_t step = group::width;; step += group::width)
+        {
+            group g(ctrl_ + pos);
+            for (std::uint64_t m = g.match(h2); m; m &= m - 1)
+            {
+                const std::size_t i = (pos + (swiss::lowest_bit(m) >> group::shift)) & mask();
+                if (eq_(slots_[i].first, key))
+                    return &slots_[i];
+            }
+            if (g.match_empty())
+                return nullptr;
+            pos = (pos + step) & mask();
+        }
+    }
+
+    static std::size_t storage_units(std::size_t capacity)
+    {
+        const std::size_t ctrl_bytes = capacity + group::width;
+        return capacity + (ctrl_bytes + sizeof(value_type) - 1) / sizeof(value_type);
+    }
+
+    void allocate_storage(std::size_t capacity)
+    {
+        slots_ = slot_traits::allocate(alloc_, storage_units(capacity));
+        ctrl_ = reinterpret_cast<ctrl_t *>(slots_ + capacity);
+        capacity_ = capacity;
+        std::memset(ctrl_, static_cast<unsigned char>(swiss::empty), capacity + group::width);
+    }
+
+    void free_storage(value_type *slots, std::size_t capacity)
+    {
+        if (slots)
+            slot_traits::deallocate(alloc_, slots, storage_units(capacity));
+    }
+
+    void destroy_slots()
+    {
+        for (std::size_t i = 0; i < capacity_; ++i)
+        {
+            if (ctrl_[i] >= 0)
+                slot_traits::destroy(alloc_, &slots_[i]);
+        }
+    }
+
+    std::size_t find_free(std::size_t h) const
+    {
+        std::size_t pos = (h >> 7) & mask();
+        for (std::size_t step = group::width;; step += group::width)
+        {
+            if (std::uint64_t m = group(ctrl_ + pos).match_empty_or_deleted())
+                return (pos + (swiss::lowest_bit(m) >> group::shift)) & mask();
+            pos = (pos + step) & mask();
+        }
+    }
+
+    void set_ctrl(std::size_t i, ctrl_t c)
+    {
+        ctrl_[i] = c;
+        if (i < group::width)
+            ctrl_[capacity_ + i] = c;
+    }
+
+    slot_alloc alloc_;
+    Hash hash_;
+    Eq eq_;
+    value_type *slots_ = nullptr;
+    ctrl_t *ctrl_ = nullptr;
+    std::size_t capacity_ = 0; // zero or a power of two >= group::width
+    std::size_t size_ = 0;
+    std::size_t deleted_ = 0;
+};
+
+template <typename Func>
+auto benchmark(Func test_func, int iterations)
+{
+    const auto start = std::chrono::system_clock::now();
+    while (iterations-- > 0)
+    {
+        test_func();
+    }
+    const auto stop = std::chrono::system_clock::now();
+    const auto secs = std::chrono::duration<double>(stop - start);
+    return secs.count();
+}
+
+// inserts the keys, then looks up every key and the same number of absent ones
+template <typename Map, typename Insert, typename Contains>
+void run(const char *name, Map &m, const std::vector<int> &keys, Insert insert, Contains contains)
+{
+    const double t_insert = benchmark([&]
+                                      {
+                                          for (int k : keys)
+                                          {
+                                              insert(m, k);
+                                          } },
+                                      1);
+    long hits = 0;
+    const double t_hit = benchmark([&]
+                                   {
+                                       for (int k : keys)
+                                       {
+                                           hits += contains(m, k);
+                                       } },
+                                   1);
+    long misses = 0;
+    const double t_miss = benchmark([&]
+                                    {
+                                        for (int k : keys)
+                                        {
+                                            misses += !contains(m, -k - 1);
+                                        } },
+                                    1);
+    const double n = static_cast<double>(keys.size());
+    std::cout << std::fixed << name << "insert = " << t_insert * 1e9 / n << " ns; hit = "
+              << t_hit * 1e9 / n << " ns; miss = " << t_miss * 1e9 / n << " ns; ("
+              << hits << " hits, " << misses << " misses)" << '\n';
+}
+
+void test_maps(std::size_t total_keys)
+{
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> dist(0, std::numeric_limits<int>::max());
+    std::vector<int> keys(total_keys);
+    for (auto &k : keys)
+    {
+        k = dist(gen); // non-negative, so -k - 1 is always a miss
+    }
+
+    std::cout << total_keys << " keys:" << '\n';
+
+    auto insert_std = [](auto &m, int k)
+    { m.emplace(k, k); };
+    auto contains_std = [](const auto &m, int k)
+    { return m.find(k) != m.end(); };
+    auto insert_own = [](auto &m, int k)
+    { m.try_emplace(k, k); };
+    auto contains_own = [](const auto &m, int k)
+    { return m.find(k) != nullptr; };
+
+    {
+        std::map<int, int> m;
+        run("  std::map:                         ", m, keys, insert_std, contains_std);
+    }
+    {
+        std::unordered_map<int, int> m;
+        run("  std::unordered_map:               ", m, keys, insert_std, contains_std);
+    }
+    {
+        node_hash_map<int, int> m;
+        run("  node_hash_map:                    ", m, keys, insert_own, contains_own);
+    }
+    {
+        std::pmr::unsynchronized_pool_resource pool;
+        node_hash_map<int, int, std::hash<int>, std::equal_to<int>, std::pmr::polymorphic_allocator<std::pair<const int, int>>> m{&pool};
+        run("  node_hash_map (pmr pool):         ", m, keys, insert_own, contains_own);
+    }
+    {
+        flat_hash_map<int, int> m;
+        run("  flat_hash_map:                    ", m, keys, insert_own, contains_own);
+    }
+    {
+        std::pmr::monotonic_buffer_resource arena;
+        flat_hash_map<int, int, std::hash<int>, std::equal_to<int>, std::pmr::polymorphic_allocator<std::pair<const int, int>>> m{&arena};
+        run("  flat_hash_map (pmr monotonic):    ", m, keys, insert_own, contains_own);
+    }
+}
+
+// my_pool_alloc frees through ordered_free, which walks the free list,
+// so it only gets a small map
+void test_my_pool_alloc()
+{
+    using node_map = node_hash_map<int, int, std::hash<int>, std::equal_to<int>, my_pool_alloc<std::pair<const int, int>>>;
+    using flat_map = flat_hash_map<int, int, std::hash<int>, std::equal_to<int>, my_pool_alloc<std::pair<const int, int>>>;
+
+    std::vector<int> keys(10'000);
+    for (std::size_t i = 0; i < keys.size(); ++i)
+    {
+        keys[i] = static_cast<int>(i * 7919);
+    }
+
+    Pool node_pool(node_map::node_size);
+    node_map nodes{my_pool_alloc<std::pair<const int, int>>(node_pool)};
+    Pool slot_pool(sizeof(std::pair<const int, int>));
+    flat_map flat{my_pool_alloc<std::pair<const int, int>>(slot_pool)};
+
+    auto insert_own = [](auto &m, int k)
+    { m.try_emplace(k, k); };
+    auto contains_own = [](const auto &m, int k)
+    { return m.find(k) != nullptr; };
+
+    std::cout << keys.size() << " keys with my_pool_alloc:" << '\n';
+    run("  node_hash_map (my_pool_alloc):    ", nodes, keys, insert_own, contains_own);
+    run("  flat_hash_map (my_pool_alloc):    ", flat, keys, insert_own, contains_own);
+
+    long sum = 0;
+    for (const auto &kv : nodes)
+    {
+        sum += kv.second;
+    }
+    for (const auto &kv : flat)
+    {
+        sum -= kv.second;
+    }
+    nodes.erase(keys[0]);
+    flat.erase(keys[0]);
+    std::cout << "  iteration check: " << sum << ", sizes after erase: " << nodes.size() << ' ' << flat.size() << '\n';
+}
+
+int main(int argc, char *argv[])
+{
+    // 1M keys by default; pass larger counts (e.g. 10000000 100000000) on big hosts
+    std::vector<std::size_t> sizes;
+    for (int i = 1; i < argc; ++i)
+    {
+        sizes.push_back(std::strtoull(argv[i], nullptr, 10));
+    }
+    if (sizes.empty())
+        sizes.push_back(1'000'000);
+
+    for (auto n : sizes)
+    {
+        test_maps(n);
+    }
+    test_my_pool_alloc();
+
+    return 0;
+}
@@ -0,0 +1,636 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Sampling heap profiler on top of replaced global operator new/delete.
+// Every thread counts down the bytes until its next sample; the distance
+// between samples is drawn from an exponential distribution with mean
+// sample_rate(), so each byte has the same chance to be sampled. An unsampled
+// allocation costs that one thread-local decrement.
+// Sampled blocks are placed in an address range reserved for them, which is how
+// delete tells them apart with a single compare.
+// Profiles use the text heap_v2 format of gperftools, pprof reads it directly:
+//   pprof --text ./16_heap_profiler heap_profiler.heap
+namespace heap_profiler
+{
+    namespace detail
+    {
+        constexpr int max_depth = 32;
+        constexpr std::size_t page = 4096;
+        constexpr std::size_t region_size = std::size_t{16} << 30;
+
+        std::atomic<std::size_t> rate{512 * 1024};
+        std::atomic<std::uintptr_t> region_begin{0};
+        std::atomic<std::uintptr_t> region_end{0};
+
+        thread_local std::int64_t bytes_until_sample = 0;
+        thread_local std::uint64_t rng = 0;
+        thread_local bool busy = false; // inside the profiler, allocations are not sampled
+
+        struct busy_scope
+        {
+            busy_scope() { busy = true; }
+            ~busy_scope() { busy = false; }
+        };
+
+        struct stack_key
+        {
+            int depth = 0;
+            std::array<void *, max_depth> frames{};
+
+            bool operator==(const stack_key &other) const
+            {
+                return depth == other.depth && std::equal(frames.begin(), frames.begin() + depth, other.frames.begin());
+            }
+        };
+
+        struct stack_hash
+        {
+            std::size_t operator()(const stack_key &k) const
+            {
+                std::size_t h = 14695981039346656037ull;
+                for (int i = 0; i != k.depth; ++i)
+                {
+                    h = (h ^ reinterpret_cast<std::uintptr_t>(k.frames[i])) * 1099511628211ull;
+                }
+                return h;
+            }
+        };
+
+        // raw sampled counts go into the profile, pprof unsamples heap_v2 itself;
+        // the estimates are for the summary printed by the process
+        struct bucket
+        {
+            std::size_t alloc_count = 0;
+            std::size_t alloc_bytes = 0;
+            std::size_t free_count = 0;
+            std::size_t free_bytes = 0;
+            double estimated_alloc_bytes = 0;
+            double estimated_free_bytes = 0;
+        };
+
+        struct live_sample
+        {
+            bucket *site;
+            std::size_t size;
+            double estimated_bytes;
+            char *slot;
+            std::size_t slot_bytes;
+        };
+
+        struct state
+        {
+            state()
+            {
+                void *p = ::mmap(nullptr, region_size, PROT_READ | PROT_WRITE,
+                                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+                if (p == MAP_FAILED)
+                    return;
+                bump = static_cast<char *>(p);
+                end = bump + region_size;
+                region_begin.store(reinterpret_cast<std::uintptr_t>(bump), std::memory_order_release);
+                region_end.store(reinterpret_cast<std::uintptr_t>(end), std::memory_order_release);
+            }
+
+            std::mutex mutex;
+            std::unordered_map<stack_key, bucket, stack_hash> sites;
+            std::unordered_map<void *, live_sample> live;
+            std::multimap<std::size_t, char *> free_slots;
+            char *bump = nullptr;
+            char *end = nullptr;
+        };
+
+        // never destroyed, deletes keep arriving during static destruction
+        state &get_state()
+        {
+            static state *s = new state;
+            return *s;
+        }
+
+        inline bool sampled(const void *p)
+        {
+            const auto a = reinterpret_cast<std::uintptr_t>(p);
+            return a - region_begin.load(std::memory_order_relaxed) <
+                   region_end.load(std::memory_order_relaxed) - region_begin.load(std::memory_order_relaxed);
+        }
+
+        void *plain_allocate(std::size_t n, std::size_t align, bool nothrow)
+        {
+            if (n == 0)
+                ++n; // avoid std::malloc(0) which may return nullptr on success
+            for (;;)
+            {
+                void *p = nullptr;
+                if (align <= alignof(std::max_align_t))
+                    p = std::malloc(n);
+                else if (::posix_memalign(&p, align, n) != 0)
+                    p = nullptr;
+                if (p)
+                    return p;
+
+                std::new_handler handler = std::get_new_handler();
+                if (!handler)
+                {
+                    if (nothrow)
+                        return nullptr;
+                    throw std::bad_alloc{};
+                }
+                handler();
+            }
+        }
+
+        // exponential with mean rate, from a per-thread xorshift
+        std::int64_t next_interval(std::size_t mean)
+        {
+            rng ^= rng << 13;
+            rng ^= rng >> 7;
+            rng ^= rng << 17;
+            const double u = (static_cast<double>(rng >> 11) + 1.0) * (1.0 / 9007199254740992.0);
+            return static_cast<std::int64_t>(-std::log(u) * static_cast<double>(mean)) + 1;
+        }
+
+        // slots are whole pages, reused best fit; big ones give their pages back when freed.
+        // A slot is only looked up here, take_slot() claims it once the sample is recorded.
+        struct slot_choice
+        {
+            char *slot = nullptr;
+            std::multimap<std::size_t, char *>::iterator reused;
+            bool is_reused = false;
+        };
+
+        slot_choice find_slot(state &s, std::size_t bytes)
+        {
+            auto it = s.free_slots.lower_bound(bytes);
+            if (it != s.free_slots.end() && it->first <= 2 * bytes)
+                return {it->second, it, true};
+            if (static_cast<std::size_t>(s.end - s.bump) < bytes)
+                return {};
+            return {s.bump, {}, false};
+        }
+
+        void take_slot(state &s, const slot_choice &c, std::size_t bytes) noexcept
+        {
+            if (c.is_reused)
+                s.free_slots.erase(c.reused);
+            else
+                s.bump += bytes;
+        }
+
+        __attribute__((noinline)) void *record(std::size_t n, std::size_t align, std::size_t mean)
+        {
+            stack_key key;
+            key.depth = ::backtrace(key.frames.data(), max_depth);
+            // drop record() and sample_allocation()
+            const int skip = std::min(key.depth, 2);
+            std::copy(key.frames.begin() + skip, key.frames.begin() + key.depth, key.frames.begin());
+            key.depth -= skip;
+
+            state &s = get_state();
+            std::lock_guard<std::mutex> lock(s.mutex);
+            const std::size_t slot_bytes = std::max((n + std::max(align, page) - page + page - 1) / page * page, page);
+            const slot_choice choice = find_slot(s, slot_bytes);
+            if (!choice.slot)
+                return nullptr; // region exhausted, the caller falls back to an unsampled block
+
+            char *p = choice.slot;
+            if (align > page)
+                p = reinterpret_cast<char *>((reinterpret_cast<std::uintptr_t>(p) + align - 1) & ~(align - 1));
+
+            // chance to be sampled was 1 - exp(-n / mean), every sample stands for 1 / chance of that
+            const double weight = 1.0 / -std::expm1(-static_cast<double>(n) / static_cast<double>(mean));
+            // the maps allocate through plain_allocate, which may throw; the slot
+            // is still unclaimed then and the caller takes an unsampled block
+            bucket *site;
+            try
+            {
+                site = &s.sites[key];
+                s.live.try_emplace(p, live_sample{site, n, weight * static_cast<double>(n), choice.slot, slot_bytes});
+            }
+            catch (const std::bad_alloc &)
+            {
+                return nullptr;
+            }
+            take_slot(s, choice, slot_bytes);
+            ++site->alloc_count;
+            site->alloc_bytes += n;
+            site->estimated_alloc_bytes += weight * static_cast<double>(n);
+            return p;
+        }
+
+        __attribute__((noinline)) void *sample_allocation(std::size_t n, std::size_t align, bool nothrow)
+        {
+            if (busy)
+                return plain_allocate(n, align, nothrow);
+            busy_scope scope;
+
+            const std::size_t mean = rate.load(std::memory_order_relaxed);
+            const bool first = rng == 0;
+            if (first)
+                rng = reinterpret_cast<std::uintptr_t>(&rng) ^ static_cast<std::uint64_t>(
+                                                                     std::chrono::steady_clock::now().time_since_epoch().count());
+            // disabled: look again after a megabyte
+            bytes_until_sample = mean ? next_interval(mean) : 1 << 20;
+            if (first || !mean)
+                return plain_allocate(n, align, nothrow);
+
+            if (void *p = record(n, align, mean))
+                return p;
+            return plain_allocate(n, align, nothrow);
+        }
+
+        void sampled_free(void *p)
+        {
+            busy_scope scope;
+            state &s = get_state();
+            std::lock_guard<std::mutex> lock(s.mutex);
+            auto it = s.live.find(p);
+            if (it == s.live.end())
+                return;
+            live_sample &l = it->second;
+            ++l.site->free_count;
+            l.site->free_bytes += l.size;
+            l.site->estimated_free_bytes += l.estimated_bytes;
+            if (l.slot_bytes >= 16 * page)
+                ::madvise(l.slot, l.slot_bytes, MADV_DONTNEED);
+            s.free_slots.emplace(l.slot_bytes, l.slot);
+            s.live.erase(it);
+        }
+
+        inline void *allocate(std::size_t n, std::size_t align, bool nothrow)
+        {
+            if ((bytes_until_sample -= static_cast<std::int64_t>(n)) > 0)
+                return plain_allocate(n, align, nothrow);
+            return sample_allocation(n, align, nothrow);
+        }
+
+        inline void deallocate(void *p) noexcept
+        {
+            if (sampled(p))
+                sampled_free(p);
+            else
+                std::free(p);
+        }
+
+        int signal_pipe[2] = {-1, -1};
+
+        // one reader thread serves every dump_on_signal call, with the latest prefix
+        struct signal_state
+        {
+            std::mutex mutex;
+            std::string prefix;
+            bool reader_started = false;
+        };
+
+        // never destroyed, the reader thread is detached
+        signal_state &get_signal_state()
+        {
+            static signal_state *s = new signal_state;
+            return *s;
+        }
+
+        void on_signal(int)
+        {
+            const int saved = errno;
+            const char c = 0;
+            [[maybe_unused]] auto r = ::write(signal_pipe[1], &c, 1);
+            errno = saved;
+        }
+    }
+
+    // mean bytes between samples, 0 turns sampling off
+    void set_sample_rate(std::size_t bytes) { detail::rate.store(bytes, std::memory_order_relaxed); }
+    std::size_t sample_rate() { return detail::rate.load(std::memory_order_relaxed); }
+
+    // live heap (inuse) and everything allocated so far (alloc) by call stack,
+    // followed by the mappings pprof needs to symbolize
+    bool dump(const char *path)
+    {
+        using namespace detail;
+        busy_scope scope;
+        std::string out;
+        {
+            state &s = get_state();
+            std::lock_guard<std::mutex> lock(s.mutex);
+            bucket total;
+            for (const auto &site : s.sites)
+            {
+                total.alloc_count += site.second.alloc_count;
+                total.alloc_bytes += site.second.alloc_bytes;
+                total.free_count += site.second.free_count;
+                total.free_bytes += site.second.free_bytes;
+            }
+
+            char line[128];
+            std::snprintf(line, sizeof(line), "heap profile: %zu: %zu [%zu: %zu] @ heap_v2/%zu\n",
+                          total.alloc_count - total.free_count, total.alloc_bytes - total.free_bytes,
+                          total.alloc_count, total.alloc_bytes, sample_rate());
+            out += line;
+            for (const auto &site : s.sites)
+            {
+                const bucket &b = site.second;
+                std::snprintf(line, sizeof(line), "%zu: %zu [%zu: %zu] @",
+                              b.alloc_count - b.free_count, b.alloc_bytes - b.free_bytes, b.alloc_count, b.alloc_bytes);
+                out += line;
+                for (int i = 0; i != site.first.depth; ++i)
+                {
+                    std::snprintf(line, sizeof(line), " %p", site.first.frames[i]);
+                    out += line;
+                }
+                out += '\n';
+            }
+        }
+
+        out += "\nMAPPED_LIBRARIES:\n";
+        const int maps = ::open("/proc/self/maps", O_RDONLY | O_CLOEXEC);
+        if (maps >= 0)
+        {
+            char buf[4096];
+            ssize_t n;
+            while ((n = ::read(maps, buf, sizeof(buf))) > 0)
+            {
+                out.append(buf, static_cast<std::size_t>(n));
+            }
+            ::close(maps);
+        }
+
+        const int fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0)
+            return false;
+        const bool ok = ::write(fd, out.data(), out.size()) == static_cast<ssize_t>(out.size());
+        ::close(fd);
+        return ok;
+    }
+
+    // every sig writes <prefix>.<n>.heap; the handler only wakes a thread,
+    // the dump itself is not async-signal-safe. Later calls add signals and
+    // change the prefix, the numbering goes on.
+    bool dump_on_signal(int sig, const std::string &prefix)
+    {
+        using namespace detail;
+        signal_state &st = get_signal_state();
+        {
+            std::lock_guard<std::mutex> lock(st.mutex);
+            if (signal_pipe[0] < 0 && ::pipe2(signal_pipe, O_CLOEXEC) != 0)
+                return false;
+            st.prefix = prefix;
+            if (!st.reader_started)
+            {
+                std::thread([&st, fd = signal_pipe[0]]
+                            {
+                                char c;
+                                for (int n = 1; ::read(fd, &c, 1) > 0; ++n)
+                                {
+                                    std::string path;
+                                    {
+                                        std::lock_guard<std::mutex> lock(st.mutex);
+                                        path = st.prefix + "." + std::to_string(n) + ".heap";
+                                    }
+                                    dump(path.c_str());
+                                } })
+                    .detach();
+                st.reader_started = true;
+            }
+        }
+
+        struct sigaction sa = {};
+        sa.sa_handler = on_signal;
+        sa.sa_flags = SA_RESTART;
+        sigemptyset(&sa.sa_mask);
+        return ::sigaction(sig, &sa, nullptr) == 0;
+    }
+
+    struct site_estimate
+    {
+        double live_bytes;
+        double allocated_bytes;
+        std::vector<void *> frames;
+    };
+
+    // call sites by estimated live bytes, largest first
+    std::vector<site_estimate> top_sites(std::size_t n)
+    {
+        using namespace detail;
+        busy_scope scope;
+        std::vector<site_estimate> sites;
+        {
+            state &s = get_state();
+            std::lock_guard<std::mutex> lock(s.mutex);
+            for (const auto &site : s.sites)
+            {
+                sites.push_back({site.second.estimated_alloc_bytes - site.second.estimated_free_bytes,
+                                 site.second.estimated_alloc_bytes,
+                                 std::vector<void *>(site.first.frames.begin(), site.first.frames.begin() + site.first.depth)});
+            }
+        }
+        std::sort(sites.begin(), sites.end(), [](const site_estimate &a, const site_estimate &b)
+                  { return a.live_bytes > b.live_bytes; });
+        sites.resize(std::min(n, sites.size()));
+        return sites;
+    }
+}
+
+// the replacements, every form ends up in allocate/deallocate
+
+void *operator new(std::size_t n) { return heap_profiler::detail::allocate(n, alignof(std::max_align_t), false); }
+void *operator new[](std::size_t n) { return heap_profiler::detail::allocate(n, alignof(std::max_align_t), false); }
+void *operator new(std::size_t n, const std::nothrow_t &) noexcept
+{
+    return heap_profiler::detail::allocate(n, alignof(std::max_align_t), true);
+}
+void *operator new[](std::size_t n, const std::nothrow_t &) noexcept
+{
+    return heap_profiler::detail::allocate(n, alignof(std::max_align_t), true);
+}
+void *operator new(std::size_t n, std::align_val_t a) { return heap_profiler::detail::allocate(n, static_cast<std::size_t>(a), false); }
+void *operator new[](std::size_t n, std::align_val_t a) { return heap_profiler::detail::allocate(n, static_cast<std::size_t>(a), false); }
+void *operator new(std::size_t n, std::align_val_t a, const std::nothrow_t &) noexcept
+{
+    return heap_profiler::detail::allocate(n, static_cast<std::size_t>(a), true);
+}
+void *operator new[](std::size_t n, std::align_val_t a, const std::nothrow_t &) noexcept
+{
+    return heap_profiler::detail::allocate(n, static_cast<std::size_t>(a), true);
+}
+
+void operator delete(void *p) noexcept { heap_profiler::detail::deallocate(p); }
+void operator delete[](void *p) noexcept { heap_profiler::detail::deallocate(p); }
+void operator delete(void *p, std::size_t) noexcept { heap_profiler::detail::deallocate(p); }
+void operator delete[](void *p, std::size_t) noexcept { heap_profiler::detail::deallocate(p); }
+void operator delete(void *p, const std::nothrow_t &) noexcept { heap_profiler::detail::deallocate(p); }
+void operator delete[](void *p, const std::nothrow_t &) noexcept { heap_profiler::detail::deallocate(p); }
+void operator delete(void *p, std::align_val_t) noexcept { heap_profiler::detail::deallocate(p); }
+void operator delete[](void *p, std::align_val_t) noexcept { heap_profiler::detail::deallocate(p); }
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept { heap_profiler::detail::deallocate(p); }
+void operator delete[](void *p, std::size_t, std::align_val_t) noexcept { heap_profiler::detail::deallocate(p); }
+void operator delete(void *p, std::align_val_t, const std::nothrow_t &) noexcept { heap_profiler::detail::deallocate(p); }
+void operator delete[](void *p, std::align_val_t, const std::nothrow_t &) noexcept { heap_profiler::detail::deallocate(p); }
+
+template <typename Func>
+auto benchmark(Func test_func, int iterations)
+{
+    const auto start = std::chrono::system_clock::now();
+    while (iterations-- > 0)
+    {
+        test_func();
+    }
+    const auto stop = std::chrono::system_clock::now();
+    const auto secs = std::chrono::duration<double>(stop - start);
+    return secs.count();
+}
+
+std::string symbol(void *addr)
+{
+    Dl_info info;
+    if (!::dladdr(addr, &info) || !info.dli_sname)
+        return "??";
+    int status = 0;
+    char *demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+    std::string name = status == 0 ? demangled : info.dli_sname;
+    std::free(demangled);
+    return name.substr(0, 60);
+}
+
+// three call sites with known footprints to check the estimates against
+
+std::vector<std::unique_ptr<std::array<char, 64>>> small_objects;
+std::vector<std::vector<char>> buffers;
+
+__attribute__((noinline)) void keep_small_objects()
+{
+    for (int i{}; i != 200'000; ++i)
+    {
+        small_objects.push_back(std::make_unique<std::array<char, 64>>());
+    }
+}
+
+__attribute__((noinline)) void keep_buffers()
+{
+    for (int i{}; i != 20; ++i)
+    {
+        buffers.emplace_back(1 << 20);
+    }
+}
+
+__attribute__((noinline)) std::size_t churn_strings()
+{
+    std::size_t total = 0;
+    for (int i{}; i != 1'000'000; ++i)
+    {
+        std::string s(100, static_cast<char>('a' + i % 26));
+        total += s.size();
+    }
+    return total;
+}
+
+void test_profile()
+{
+    keep_small_objects();
+    keep_buffers();
+    const std::size_t churned = churn_strings();
+
+    std::cout << "actual live: small objects " << (small_objects.size() * 64 >> 10) << " kB, buffers "
+              << (buffers.size() << 10) << " kB; churned strings " << (churned >> 10) << " kB, none live\n"
+              << "estimated from 1 sample per " << (heap_profiler::sample_rate() >> 10) << " kB:\n";
+    for (const auto &site : heap_profiler::top_sites(4))
+    {
+        std::cout << "  live " << static_cast<std::size_t>(site.live_bytes) / 1024 << " kB, allocated "
+                  << static_cast<std::size_t>(site.allocated_bytes) / 1024 << " kB:";
+        // frames of the profiler itself only show up when it is not inlined
+        int shown = 0;
+        for (void *frame : site.frames)
+        {
+            const std::string name = symbol(frame);
+            if (name.rfind("heap_profiler::", 0) == 0 || name.rfind("operator new", 0) == 0)
+                continue;
+            std::cout << (shown ? " <- " : " ") << name;
+            if (++shown == 3)
+                break;
+        }
+        std::cout << '\n';
+    }
+
+    const char *path = "heap_profiler.heap";
+    if (heap_profiler::dump(path))
+        std::cout << "profile written to " << path << '\n';
+    std::raise(SIGUSR2);
+}
+
+// cost on the allocation path; operator new and delete are reached through
+// volatile pointers so the pairs are not elided
+void test_overhead()
+{
+    constexpr int iterations{20'000'000};
+    std::array<void *, 64> live{};
+    std::size_t n = 0;
+    void *(*volatile new_fn)(std::size_t) = &::operator new;
+    void (*volatile delete_fn)(void *) = &::operator delete;
+    void *(*volatile malloc_fn)(std::size_t) = &std::malloc;
+    void (*volatile free_fn)(void *) = &std::free;
+
+    auto churn = [&](auto alloc, auto release)
+    {
+        const double secs = benchmark([&]
+                                      {
+                                          void *&slot = live[n++ % live.size()];
+                                          release(slot);
+                                          slot = alloc(64); },
+                                      iterations);
+        for (auto &slot : live)
+        {
+            release(slot);
+            slot = nullptr;
+        }
+        return secs * 1e9 / iterations;
+    };
+
+    const double t1 = churn(malloc_fn, free_fn);
+    const std::size_t rate = heap_profiler::sample_rate();
+    heap_profiler::set_sample_rate(0);
+    const double t2 = churn(new_fn, delete_fn);
+    heap_profiler::set_sample_rate(rate);
+    const double t3 = churn(new_fn, delete_fn);
+
+    // t1 skips the call into the replacement, t2 against t3 is what sampling costs
+    std::cout << std::fixed << "allocate/free pairs of 64 bytes:\n"
+              << "  t1 (malloc/free):                  " << t1 << " ns/pair\n"
+              << "  t2 (operator new, sampling off):   " << t2 << " ns/pair\n"
+              << "  t3 (operator new, sampling on):    " << t3 << " ns/pair\n";
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1)
+        heap_profiler::set_sample_rate(std::stoul(argv[1]));
+    heap_profiler::dump_on_signal(SIGUSR2, "heap_profiler");
+
+    test_profile();
+    test_overhead();
+
+    // give the signal thread a moment to write its dump
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    return 0;
+}
@@ -0,0 +1,346 @@
+#include "my_pool_alloc.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Pool owned by one thread that other threads may free into.
+// A remote free is pushed onto an atomic list; the owner hands the whole
+// list back to the Pool in one batch the next time it allocates. Only the
+// owner ever touches the Pool, so the Pool itself stays single threaded.
+class remote_free_pool
+{
+public:
+    explicit remote_free_pool(std::size_t chunk_size, std::size_t next_size = 1024)
+        : pool_(std::max(chunk_size, sizeof(free_node)), next_size) {}
+
+    remote_free_pool(const remote_free_pool &) = delete;
+    remote_free_pool &operator=(const remote_free_pool &) = delete;
+
+    // owner thread only
+    void *allocate()
+    {
+        if (remote_.load(std::memory_order_relaxed))
+            reclaim();
+        void *p = pool_.malloc();
+        if (!p)
+            throw std::bad_alloc();
+        ++live_;
+        return p;
+    }
+
+    // owner thread only
+    void deallocate(void *p)
+    {
+        pool_.free(p);
+        --live_;
+    }
+
+    // any thread
+    void remote_deallocate(void *p)
+    {
+        auto *n = ::new (p) free_node;
+        n->next = remote_.load(std::memory_order_relaxed);
+        while (!remote_.compare_exchange_weak(n->next, n, std::memory_order_release, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    // owner thread only, returns the number of chunks taken back
+    std::size_t reclaim()
+    {
+        free_node *n = remote_.exchange(nullptr, std::memory_order_acquire);
+        if (!n)
+            return 0;
+        std::size_t count = 0;
+        while (n)
+        {
+            free_node *next = n->next;
+            pool_.free(n);
+            n = next;
+            ++count;
+        }
+        live_ -= count;
+        ++batches_;
+        return count;
+    }
+
+    std::size_t live() const { return live_; }
+    std::size_t batches() const { return batches_; }
+
+private:
+    struct free_node
+    {
+        free_node *next;
+    };
+
+    Pool pool_;
+    std::size_t live_ = 0;
+    std::size_t batches_ = 0;
+    // written by the consumers, kept off the owner's cache line
+    alignas(64) std::atomic<free_node *> remote_{nullptr};
+};
+
+struct mpsc_node
+{
+    std::atomic<mpsc_node *> next{nullptr};
+};
+
+// Intrusive multi-producer single-consumer queue (Vyukov).
+// push is one atomic exchange and never waits for another producer;
+// pop may only be called from one consumer thread.
+class mpsc_queue
+{
+public:
+    mpsc_queue() : head_(&stub_), tail_(&stub_) {}
+
+    mpsc_queue(const mpsc_queue &) = delete;
+    mpsc_queue &operator=(const mpsc_queue &) = delete;
+
+    void push(mpsc_node *n)
+    {
+        n->next.store(nullptr, std::memory_order_relaxed);
+        mpsc_node *prev = head_.exchange(n, std::memory_order_acq_rel);
+        prev->next.store(n, std::memory_order_release);
+    }
+
+    // nullptr when empty, or while a producer is between its two steps;
+    // a node is only handed out once nobody links to it any more
+    mpsc_node *pop()
+    {
+        mpsc_node *tail = tail_;
+        mpsc_node *next = tail->next.load(std::memory_order_acquire);
+        if (tail == &stub_)
+        {
+            if (!next)
+                return nullptr;
+            tail_ = next;
+            tail = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+        if (next)
+        {
+            tail_ = next;
+            return tail;
+        }
+        if (tail != head_.load(std::memory_order_acquire))
+            return nullptr;
+        push(&stub_);
+        next = tail->next.load(std::memory_order_acquire);
+        if (next)
+        {
+            tail_ = next;
+            return tail;
+        }
+        return nullptr;
+    }
+
+private:
+    alignas(64) std::atomic<mpsc_node *> head_;
+    alignas(64) mpsc_node *tail_;
+    mpsc_node stub_;
+};
+
+struct message : mpsc_node
+{
+    remote_free_pool *owner = nullptr;
+    std::uint64_t seq = 0;
+    std::int64_t sent_ns = 0;
+    int producer = 0;
+    char payload[36] = {};
+};
+
+std::int64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+// producers stop running ahead of the consumer at this many messages in flight
+constexpr std::size_t window{4'096};
+
+struct result
+{
+    double secs = 0;
+    std::vector<std::int64_t> latency_ns;
+    std::uint64_t checksum = 0;
+    std::size_t batches = 0;
+};
+
+void print(const char *name, int producers, std::size_t messages, result &r)
+{
+    auto &lat = r.latency_ns;
+    std::sort(lat.begin(), lat.end());
+    auto pct = [&](double p)
+    { return lat[std::min(lat.size() - 1, static_cast<std::size_t>(p * lat.size()))] / 1000.0; };
+
+    std::cout << std::fixed << name << ", " << producers << " producer(s): " << r.secs << " sec; "
+              << messages / r.secs / 1e6 << " M msg/s; latency us p50 = " << pct(0.5)
+              << ", p99 = " << pct(0.99) << ", p99.9 = " << pct(0.999)
+              << ", max = " << lat.back() / 1000.0;
+    if (r.batches)
+        std::cout << "; reclaim batches = " << r.batches;
+    std::cout << "; checksum = " << r.checksum << '\n';
+}
+
+// std::queue behind a mutex, messages from std::allocator
+result run_locked(int producers, std::size_t per_producer)
+{
+    std::mutex m;
+    std::condition_variable cv;
+    std::queue<message *> q;
+    std::unique_ptr<std::atomic<std::size_t>[]> consumed(new std::atomic<std::size_t>[producers]);
+    for (int i{}; i != producers; ++i)
+    {
+        consumed[i] = 0;
+    }
+
+    result r;
+    const std::size_t total = per_producer * producers;
+    r.latency_ns.reserve(total);
+
+    const auto start = std::chrono::steady_clock::now();
+    std::thread consumer([&]
+                         {
+                             std::allocator<message> alloc;
+                             for (std::size_t received{}; received != total; ++received)
+                             {
+                                 std::unique_lock<std::mutex> lock(m);
+                                 cv.wait(lock, [&] { return !q.empty(); });
+                                 message *msg = q.front();
+                                 q.pop();
+                                 lock.unlock();
+
+                                 r.latency_ns.push_back(now_ns() - msg->sent_ns);
+                                 r.checksum += msg->seq;
+                                 consumed[msg->producer].fetch_add(1, std::memory_order_release);
+                                 msg->~message();
+                                 alloc.deallocate(msg, 1);
+                             } });
+
+    std::vector<std::thread> threads;
+    for (int id{}; id != producers; ++id)
+    {
+        threads.emplace_back([&, id]
+                             {
+                                 std::allocator<message> alloc;
+                                 for (std::size_t i{}; i != per_producer; ++i)
+                                 {
+                                     while (i - consumed[id].load(std::memory_order_acquire) >= window)
+                                     {
+                                         std::this_thread::yield();
+                                     }
+                                     message *msg = ::new (alloc.allocate(1)) message;
+                                     msg->seq = i;
+                                     msg->producer = id;
+                                     msg->sent_ns = now_ns();
+
+                                     std::unique_lock<std::mutex> lock(m);
+                                     const bool was_empty = q.empty();
+                                     q.push(msg);
+                                     lock.unlock();
+                                     if (was_empty)
+                                         cv.notify_one();
+                                 } });
+    }
+    for (auto &t : threads)
+    {
+        t.join();
+    }
+    consumer.join();
+    r.secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return r;
+}
+
+// mpsc_queue, every producer allocates from its own remote_free_pool
+result run_mpsc(int producers, std::size_t per_producer)
+{
+    mpsc_queue q;
+    std::atomic<std::size_t> batches{0};
+
+    result r;
+    const std::size_t total = per_producer * producers;
+    r.latency_ns.reserve(total);
+
+    const auto start = std::chrono::steady_clock::now();
+    std::thread consumer([&]
+                         {
+                             for (std::size_t received{}; received != total;)
+                             {
+                                 auto *msg = static_cast<message *>(q.pop());
+                                 if (!msg)
+                                 {
+                                     std::this_thread::yield();
+                                     continue;
+                                 }
+                                 ++received;
+                                 r.latency_ns.push_back(now_ns() - msg->sent_ns);
+                                 r.checksum += msg->seq;
+                                 remote_free_pool *owner = msg->owner;
+                                 msg->~message();
+                                 owner->remote_deallocate(msg);
+                             } });
+
+    std::vector<std::thread> threads;
+    for (int id{}; id != producers; ++id)
+    {
+        threads.emplace_back([&, id]
+                             {
+                                 remote_free_pool pool(sizeof(message));
+                                 for (std::size_t i{}; i != per_producer; ++i)
+                                 {
+                                     // the returned nodes are the flow control
+                                     while (pool.live() >= window && !pool.reclaim())
+                                     {
+                                         std::this_thread::yield();
+                                     }
+                                     auto *msg = ::new (pool.allocate()) message;
+                                     msg->owner = &pool;
+                                     msg->seq = i;
+                                     msg->producer = id;
+                                     msg->sent_ns = now_ns();
+                                     q.push(msg);
+                                 }
+                                 // the pool has to outlive its last message
+                                 while (pool.live())
+                                 {
+                                     if (!pool.reclaim())
+                                         std::this_thread::yield();
+                                 }
+                                 batches += pool.batches(); });
+    }
+    for (auto &t : threads)
+    {
+        t.join();
+    }
+    consumer.join();
+    r.secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    r.batches = batches;
+    return r;
+}
+
+int main(int argc, char *argv[])
+{
+    const std::size_t messages = argc > 1 ? std::stoul(argv[1]) : 2'000'000;
+
+    for (int producers : {1, 3})
+    {
+        const std::size_t per_producer = messages / producers;
+        result t1 = run_locked(producers, per_producer);
+        print("t1 (std::queue + mutex, std::allocator)", producers, per_producer * producers, t1);
+        result t2 = run_mpsc(producers, per_producer);
+        print("t2 (mpsc_queue, remote_free_pool)     ", producers, per_producer * producers, t2);
+    }
+
+    return 0;
+}
@@ -1,4 +1,7 @@
-#include <boost/pool/pool.hpp>
+#define USE_PRETTY 1
+
+#include "my_pool_alloc.h"
+
 #include <boost/pool/pool_alloc.hpp>
 #include <iostream>
 #include <map>
@@ -6,134 +9,12 @@
 #include <array>
 #include <utility>
 
-using Pool = boost::pool<boost::default_user_allocator_new_delete>;
-
-const int DEFAULT_SIZE_POOL = 10;
-
-
-
-template <typename T, int def_size = DEFAULT_SIZE_POOL>
-struct my_pool_alloc {
-public:
-    using value_type = T;
-
-    ~my_pool_alloc() = default;
-
-    template <typename U>
-    struct rebind {
-        using other = my_pool_alloc<U, def_size>;
-    };
-
-    my_pool_alloc() : pool_ (new Pool(sizeof(T) * def_size/*nrequested_size*/, 32/*nnext_size*/, 32/*nmax_size*/)) {
-        std::cout << __PRETTY_FUNCTION__ << std::endl;
-    }
-
-    // template <typename U, typename... Args>
-    // void construct(U* p, Args&&... args) {
-    //     new (p) U(std::forward<Args>(args)...);
-    // }
-
-    my_pool_alloc(const size_t size) : pool_(new Pool(sizeof(T) * size)) {
-        std::cout << __PRETTY_FUNCTION__ << std::endl;
-    }
-    
-    my_pool_alloc(T& ref_val, const size_t size) : pool_(new Pool(sizeof(T) * size)) {
-        std::cout << __PRETTY_FUNCTION__ << std::endl;
-    }
-
-    my_pool_alloc(Pool& pool) : pool_(&pool) {
-        std::cout << __PRETTY_FUNCTION__ << std::endl;
-        assert(pool_size() >= sizeof(T));
-    }
-
-    template <typename U>
-    my_pool_alloc(my_pool_alloc<U> const& other) : pool_(other._pool) {
-        std::cout << __PRETTY_FUNCTION__ << std::endl;
-        assert(pool_size() >= sizeof(U));
-    }
-
-      T *allocate(const size_t n) {
-        std::cout << __PRETTY_FUNCTION__ << std::endl;
-        T* ret = static_cast<T*>(pool_->ordered_malloc(n));
-        if (!ret && n) throw std::bad_alloc();
-        return ret;
-    }
-
-
-    void deallocate(T* ptr, const size_t n) {
-        std::cout << __PRETTY_FUNCTION__ << std::endl;
-        if (ptr && n) pool_->ordered_free(ptr, n);
-    }
-
-    // for comparing
-    size_t pool_size() const { return pool_->get_requested_size(); }
-
-    private:
-    Pool* pool_;
-};
-
-template <class T, class U> bool operator==(const my_pool_alloc<T> &a, const my_pool_alloc<U> &b) { return a.pool_size()==b.pool_size(); }
-template <class T, class U> bool operator!=(const my_pool_alloc<T> &a, const my_pool_alloc<U> &b) { return a.pool_size()!=b.pool_size(); }
-
-
 int factorial(int n) {
     if (n == 0) return 1;
     return n * factorial(n - 1);
 };
 
 
-template <class T, class Allocator = std::allocator<T>>
-class my_vector
-{
-public: 
-
-    my_vector(){};
-
-    my_vector(const Allocator other): alloc(other) {}
-
-    my_vector(const size_t n, const Allocator other): alloc(other), capacity(n) {}
-
-    void push_back(const T &x)
-    {
-        if (size == capacity)
-        {
-            capacity = capacity * 2 + 1;
-            // T* newData = ::operator new(capacity * sizeof(T));
-             T* tmp = alloc.allocate(capacity);
-            for (size_t i = 0; i < size; i++) {
-                tmp[i] = data[i];
-            }
-
-            alloc.deallocate(data, size);
-            data = tmp;
-        }
-
-        data[size] = x;
-        ++size;
-    }
-
-    T& operator[](std::size_t pos) {
-    if (pos >= 0 && pos <= size) return *(this->data + pos);
-    throw std::out_of_range("Out of bounds element access");
-    }
-
-    T *begin() { return data; };
-
-    T *end() { return data + size; };
-
-    const T *begin() const { return data; };
-
-    const T *end() const { return data + size; };
-
-private:
-    size_t size = 0;
-    size_t capacity = 0;
-    T *data = nullptr;
-
-    Allocator alloc;
-};
-
-
 int main() {
     //using boost::container::vector;
     using std::vector;
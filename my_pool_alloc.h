@@ -0,0 +1,704 @@
+#pragma once
+
+#include <boost/pool/pool.hpp>
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// define USE_PRETTY before including to trace every allocator call
+
+using Pool = boost::pool<boost::default_user_allocator_new_delete>;
+
+const int DEFAULT_SIZE_POOL = 10;
+
+// zeroes one byte in every page of [p, p + bytes), taking the page faults now
+inline void prefault(void *p, size_t bytes)
+{
+    constexpr size_t page = 4096;
+    volatile char *c = static_cast<char *>(p);
+    for (size_t off = 0; off < bytes; off += page)
+    {
+        c[off] = 0;
+    }
+    if (bytes)
+        c[bytes - 1] = 0;
+}
+
+// boost::pool keeps its block list and free list protected,
+// pointers to members named through derived classes reach them legally
+struct pool_access : Pool
+{
+    using storage = boost::simple_segregated_storage<Pool::size_type>;
+    using blocks_t = boost::details::PODptr<Pool::size_type>;
+
+    struct storage_access : storage
+    {
+        static void *head(const storage &s) { return s.*(&storage_access::first); }
+    };
+
+    static blocks_t blocks(const Pool &p) { return p.*(&pool_access::list); }
+    static size_t chunk_size(const Pool &p) { return (p.*(&pool_access::alloc_size))(); }
+    static void *free_head(const Pool &p) { return storage_access::head(p); }
+};
+
+
+
+template <typename T, int def_size = DEFAULT_SIZE_POOL>
+struct my_pool_alloc {
+public:
+    using value_type = T;
+
+    ~my_pool_alloc() = default;
+
+    template <typename U>
+    struct rebind {
+        using other = my_pool_alloc<U, def_size>;
+    };
+
+    my_pool_alloc() : pool_ (new Pool(sizeof(T) * def_size/*nrequested_size*/, 32/*nnext_size*/, 32/*nmax_size*/)) {
+#ifdef USE_PRETTY
+        std::cout << __PRETTY_FUNCTION__ << std::endl;
+#endif
+    }
+
+    // template <typename U, typename... Args>
+    // void construct(U* p, Args&&... args) {
+    //     new (p) U(std::forward<Args>(args)...);
+    // }
+
+    my_pool_alloc(const size_t size) : pool_(new Pool(sizeof(T) * size)) {
+#ifdef USE_PRETTY
+        std::cout << __PRETTY_FUNCTION__ << std::endl;
+#endif
+    }
+    
+    my_pool_alloc(T& ref_val, const size_t size) : pool_(new Pool(sizeof(T) * size)) {
+#ifdef USE_PRETTY
+        std::cout << __PRETTY_FUNCTION__ << std::endl;
+#endif
+    }
+
+    my_pool_alloc(Pool& pool) : pool_(&pool) {
+#ifdef USE_PRETTY
+        std::cout << __PRETTY_FUNCTION__ << std::endl;
+#endif
+        assert(pool_size() >= sizeof(T));
+    }
+
+    template <typename U>
+    my_pool_alloc(my_pool_alloc<U, def_size> const& other) : pool_(other.pool_) {
+#ifdef USE_PRETTY
+        std::cout << __PRETTY_FUNCTION__ << std::endl;
+#endif
+        assert(pool_size() >= sizeof(U));
+    }
+
+      T *allocate(const size_t n) {
+#ifdef USE_PRETTY
+        std::cout << __PRETTY_FUNCTION__ << std::endl;
+#endif
+        T* ret = static_cast<T*>(pool_->ordered_malloc(n));
+        if (!ret && n) throw std::bad_alloc();
+        return ret;
+    }
+
+
+    void deallocate(T* ptr, const size_t n) {
+#ifdef USE_PRETTY
+        std::cout << __PRETTY_FUNCTION__ << std::endl;
+#endif
+        if (ptr && n) pool_->ordered_free(ptr, n);
+    }
+
+    // Readies the pool for n more allocate(1) calls: takes a run of n chunks
+    // (growing the pool if it has none), writes every page of it once and
+    // gives it back, so neither a new block nor a first-touch page fault
+    // lands on those calls. ordered_malloc counts in requested sizes while
+    // chunks are rounded up to the pool's partition size, so the run is asked
+    // for in enough requested sizes to cover n whole chunks.
+    void reserve(const size_t n) {
+#ifdef USE_PRETTY
+        std::cout << __PRETTY_FUNCTION__ << std::endl;
+#endif
+        if (!n) return;
+        const size_t chunk = pool_access::chunk_size(*pool_);
+        const size_t units = (n * chunk + pool_size() - 1) / pool_size();
+        void* run = pool_->ordered_malloc(units);
+        if (!run) throw std::bad_alloc();
+        prefault(run, (units * pool_size() + chunk - 1) / chunk * chunk);
+        pool_->ordered_free(run, units);
+    }
+
+    size_t pool_size() const { return pool_->get_requested_size(); }
+
+    Pool& pool() const { return *pool_; }
+
+    private:
+    template <typename, int> friend struct my_pool_alloc;
+
+    Pool* pool_;
+};
+
+// equal only when drawing from the same pool: one may free what the other allocated
+template <class T, class U> bool operator==(const my_pool_alloc<T> &a, const my_pool_alloc<U> &b) { return &a.pool()==&b.pool(); }
+template <class T, class U> bool operator!=(const my_pool_alloc<T> &a, const my_pool_alloc<U> &b) { return &a.pool()!=&b.pool(); }
+
+
+// default reset hook of object_pool: calls t.reset()
+struct member_reset
+{
+    template <class T>
+    void operator()(T &t) const { t.reset(); }
+};
+
+// Pool of constructed objects.
+// A released object is put through the reset hook and kept alive, so the next
+// acquire gets it back without construction and with the capacities of its
+// strings and vectors intact. The hook has to leave it equivalent to a fresh
+// object. Storage for new objects comes from a Pool of sizeof(T) chunks;
+// beyond max_cached, released objects are destroyed instead of kept.
+// Not thread safe, handles must not outlive the pool.
+template <class T, class Reset = member_reset>
+class object_pool
+{
+    static_assert(alignof(T) <= alignof(std::max_align_t), "Pool chunks are only max_align_t aligned");
+
+public:
+    struct recycler
+    {
+        object_pool *pool;
+        void operator()(T *p) const { pool->release(p); }
+    };
+    using handle = std::unique_ptr<T, recycler>;
+
+    explicit object_pool(size_t max_cached = 1024, Reset reset = Reset())
+        : pool_(sizeof(T), 64), reset_(reset), max_cached_(max_cached)
+    {
+        cached_.reserve(max_cached);
+    }
+
+    object_pool(const object_pool &) = delete;
+    object_pool &operator=(const object_pool &) = delete;
+
+    ~object_pool()
+    {
+        assert(live_ == 0);
+        trim(0);
+    }
+
+    handle acquire()
+    {
+        ++live_;
+        if (!cached_.empty())
+        {
+            T *p = cached_.back();
+            cached_.pop_back();
+            ++reused_;
+            return handle(p, recycler{this});
+        }
+
+        void *mem = pool_.malloc();
+        if (!mem)
+        {
+            --live_;
+            throw std::bad_alloc();
+        }
+        T *p;
+        try
+        {
+            p = ::new (mem) T();
+        }
+        catch (...)
+        {
+            pool_.free(mem);
+            --live_;
+            throw;
+        }
+        ++created_;
+        return handle(p, recycler{this});
+    }
+
+    // a throwing hook costs the object, not the pool
+    void release(T *p)
+    {
+        --live_;
+        if (cached_.size() < max_cached_)
+        {
+            try
+            {
+                reset_(*p);
+                cached_.push_back(p);
+                return;
+            }
+            catch (...)
+            {
+            }
+        }
+        destroy(p);
+    }
+
+    // destroys cached objects until at most n are left
+    void trim(size_t n)
+    {
+        while (cached_.size() > n)
+        {
+            destroy(cached_.back());
+            cached_.pop_back();
+        }
+    }
+
+    size_t cached() const { return cached_.size(); }
+    size_t live() const { return live_; }
+    size_t created() const { return created_; }
+    size_t reused() const { return reused_; }
+
+private:
+    void destroy(T *p)
+    {
+        p->~T();
+        pool_.free(p);
+    }
+
+    Pool pool_;
+    Reset reset_;
+    size_t max_cached_;
+    std::vector<T *> cached_;
+    size_t live_ = 0;
+    size_t created_ = 0;
+    size_t reused_ = 0;
+};
+
+
+// Free-chunk layout of a Pool: how many chunks are free and how they are
+// grouped into address-contiguous runs that ordered_malloc(n) could use.
+struct pool_stats
+{
+    size_t blocks = 0;
+    size_t block_bytes = 0; // taken from the user allocator
+    size_t chunk_size = 0;
+    size_t chunks = 0;
+    size_t free_chunks = 0;
+    size_t free_runs = 0;
+    size_t largest_free_run = 0;
+    std::array<size_t, 32> run_histogram{}; // [k]: runs of 2^k .. 2^(k+1)-1 chunks
+
+    // 0 when all free chunks form one run, close to 1 when they are scattered
+    double fragmentation() const
+    {
+        return free_chunks ? 1.0 - static_cast<double>(largest_free_run) / free_chunks : 0.0;
+    }
+};
+
+// walks every block chunk by chunk; the free list is in address order
+// because my_pool_alloc only uses the ordered_ calls
+inline pool_stats inspect_pool(const Pool &pool)
+{
+    pool_stats st;
+    st.chunk_size = pool_access::chunk_size(pool);
+
+    std::less<const void *> lt;
+    void *free_p = pool_access::free_head(pool);
+    for (auto block = pool_access::blocks(pool); block.valid(); block = block.next())
+    {
+        ++st.blocks;
+        st.block_bytes += block.total_size();
+
+        size_t run = 0;
+        auto close_run = [&st, &run]
+        {
+            if (!run)
+                return;
+            size_t k = 0;
+            while ((run >> (k + 1)) != 0)
+                ++k;
+            ++st.run_histogram[k];
+            ++st.free_runs;
+            st.largest_free_run = std::max(st.largest_free_run, run);
+            run = 0;
+        };
+
+        // free chunks of earlier blocks were consumed already, skip strays before this one
+        while (free_p && lt(free_p, block.begin()))
+            free_p = *static_cast<void **>(free_p);
+
+        for (char *chunk = block.begin(); chunk != block.end(); chunk += st.chunk_size)
+        {
+            ++st.chunks;
+            if (chunk == free_p)
+            {
+                ++st.free_chunks;
+                ++run;
+                free_p = *static_cast<void **>(free_p);
+            }
+            else
+            {
+                close_run();
+            }
+        }
+        close_run();
+    }
+    return st;
+}
+
+template <class T, class Allocator = std::allocator<T>>
+class my_vector
+{
+public: 
+
+    my_vector(){};
+
+    my_vector(const Allocator other): alloc(other) {}
+
+    my_vector(const size_t n, const Allocator other): alloc(other), capacity_(n) {}
+
+    my_vector(const my_vector &) = delete;
+    my_vector &operator=(const my_vector &) = delete;
+
+    my_vector(my_vector &&other) noexcept
+        : size_(other.size_), capacity_(other.capacity_), data_(other.data_), alloc(other.alloc)
+    {
+        other.size_ = other.capacity_ = 0;
+        other.data_ = nullptr;
+    }
+
+    my_vector &operator=(my_vector &&other) noexcept
+    {
+        std::swap(size_, other.size_);
+        std::swap(capacity_, other.capacity_);
+        std::swap(data_, other.data_);
+        std::swap(alloc, other.alloc);
+        return *this;
+    }
+
+    ~my_vector()
+    {
+        if (data_)
+            alloc.deallocate(data_, capacity_);
+    }
+
+    void push_back(const T &x)
+    {
+        if (size_ == capacity_)
+        {
+            capacity_ = capacity_ * 2 + 1;
+            // T* newData = ::operator new(capacity * sizeof(T));
+             T* tmp = alloc.allocate(capacity_);
+            for (size_t i = 0; i < size_; i++) {
+                tmp[i] = data_[i];
+            }
+
+            alloc.deallocate(data_, size_);
+            data_ = tmp;
+        }
+
+        data_[size_] = x;
+        ++size_;
+    }
+
+    // grows to exactly n elements, new ones are value-initialized
+    void resize(const size_t n)
+    {
+        if (n > capacity_ || (n && !data_))
+        {
+            T* tmp = alloc.allocate(n);
+            for (size_t i = 0; i < size_; i++) {
+                tmp[i] = data_[i];
+            }
+            if (data_)
+                alloc.deallocate(data_, capacity_);
+            data_ = tmp;
+            capacity_ = n;
+        }
+        for (size_t i = size_; i < n; i++) {
+            data_[i] = T();
+        }
+        size_ = n;
+    }
+
+    T& operator[](std::size_t pos) {
+    if (pos >= 0 && pos <= size_) return *(this->data_ + pos);
+    throw std::out_of_range("Out of bounds element access");
+    }
+
+    // Relocation hook for pool compaction: moves the buffer when the allocator
+    // hands out a lower address for it (optionally trimmed to size()). With an
+    // address-ordered pool that packs live data into the first blocks, so the
+    // tail blocks empty out and Pool::release_memory() can give them back.
+    bool compact(bool shrink = false)
+    {
+        if (!data_)
+            return false;
+        const size_t wanted = shrink ? size_ : capacity_;
+        if (!wanted)
+        {
+            alloc.deallocate(data_, capacity_);
+            data_ = nullptr;
+            capacity_ = 0;
+            return true;
+        }
+
+        T *tmp = alloc.allocate(wanted);
+        if (std::less<T *>()(data_, tmp) && wanted == capacity_)
+        {
+            alloc.deallocate(tmp, wanted);
+            return false;
+        }
+        for (size_t i = 0; i < size_; i++) {
+            tmp[i] = data_[i];
+        }
+        alloc.deallocate(data_, capacity_);
+        data_ = tmp;
+        capacity_ = wanted;
+        return true;
+    }
+
+    size_t size() const { return size_; }
+
+    size_t capacity() const { return capacity_; }
+
+    T *begin() { return data_; };
+
+    T *end() { return data_ + size_; };
+
+    const T *begin() const { return data_; };
+
+    const T *end() const { return data_ + size_; };
+
+private:
+    size_t size_ = 0;
+    size_t capacity_ = 0;
+    T *data_ = nullptr;
+
+    Allocator alloc;
+};
+
+// Vector made of def_size-element segments, each one chunk of a Pool of
+// sizeof(T) * def_size chunks (the chunk size my_pool_alloc<T, def_size> uses).
+// Growth takes one more chunk and never moves an element, so references stay
+// valid; element i is found through a small index of segment pointers.
+// push_back costs the same every time only while the pool has free chunks:
+// an owned pool starts empty and every 32 segments news and segregates a new
+// block, which shows up in the tail latency. reserve(), a warm pool or a pool
+// shared with vectors that shrink keep that off the pushes.
+// A segment goes back to the pool once the vector shrinks a whole segment
+// below it, one spare is kept to avoid thrashing at a boundary. Not thread
+// safe; with a shared pool, the pool has to outlive the vector.
+template <class T, int def_size = DEFAULT_SIZE_POOL>
+class segmented_vector
+{
+    static_assert(def_size > 0, "segments hold at least one element");
+    static_assert(alignof(T) <= alignof(std::max_align_t), "Pool chunks are only max_align_t aligned");
+
+public:
+    static constexpr size_t segment_size = def_size;
+
+    template <class V, class Seg>
+    class basic_iterator
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using pointer = V *;
+        using reference = V &;
+
+        basic_iterator() = default;
+        basic_iterator(Seg *seg, V *cur) : seg_(seg), cur_(cur), last_(cur ? *seg + def_size : nullptr) {}
+
+        template <class W, class = std::enable_if_t<std::is_const_v<V> && !std::is_const_v<W>>>
+        basic_iterator(const basic_iterator<W, Seg> &o) : seg_(o.seg_), cur_(o.cur_), last_(o.last_) {}
+
+        reference operator*() const { return *cur_; }
+        pointer operator->() const { return cur_; }
+
+        basic_iterator &operator++()
+        {
+            if (++cur_ == last_)
+            {
+                cur_ = *++seg_;
+                last_ = cur_ ? cur_ + def_size : nullptr;
+            }
+            return *this;
+        }
+        basic_iterator operator++(int)
+        {
+            basic_iterator old = *this;
+            ++*this;
+            return old;
+        }
+
+        bool operator==(const basic_iterator &o) const { return cur_ == o.cur_; }
+        bool operator!=(const basic_iterator &o) const { return cur_ != o.cur_; }
+
+    private:
+        template <class, class> friend class basic_iterator;
+
+        Seg *seg_ = nullptr;
+        V *cur_ = nullptr;
+        V *last_ = nullptr;
+    };
+
+    using iterator = basic_iterator<T, T *const>;
+    using const_iterator = basic_iterator<const T, T *const>;
+
+    segmented_vector() : own_(new Pool(sizeof(T) * def_size, 32, 32)), pool_(own_.get()) { init_index(); }
+
+    explicit segmented_vector(Pool &pool) : pool_(&pool)
+    {
+        assert(pool.get_requested_size() >= sizeof(T) * def_size);
+        init_index();
+    }
+
+    segmented_vector(const segmented_vector &) = delete;
+    segmented_vector &operator=(const segmented_vector &) = delete;
+
+    // the moved-from vector can only be destroyed or assigned to
+    segmented_vector(segmented_vector &&other) noexcept
+        : own_(std::move(other.own_)), pool_(other.pool_), segments_(std::move(other.segments_)), size_(other.size_)
+    {
+        other.size_ = 0;
+        other.init_index();
+    }
+
+    segmented_vector &operator=(segmented_vector &&other) noexcept
+    {
+        std::swap(own_, other.own_);
+        std::swap(pool_, other.pool_);
+        std::swap(segments_, other.segments_);
+        std::swap(size_, other.size_);
+        return *this;
+    }
+
+    ~segmented_vector()
+    {
+        clear();
+        shrink_to_fit();
+    }
+
+    void push_back(const T &x) { emplace_back(x); }
+    void push_back(T &&x) { emplace_back(std::move(x)); }
+
+    template <class... Args>
+    T &emplace_back(Args &&...args)
+    {
+        const size_t off = size_ % def_size;
+        if (off == 0 && size_ / def_size == capacity() / def_size)
+            add_segment();
+        T *p = ::new (segments_[size_ / def_size] + off) T(std::forward<Args>(args)...);
+        ++size_;
+        return *p;
+    }
+
+    // takes the segments for n elements now and touches their pages, so pushes
+    // up to n neither grow the pool nor fault; the first pop_back gives back
+    // what is reserved past one spare segment
+    void reserve(size_t n)
+    {
+        const size_t wanted = (n + def_size - 1) / def_size;
+        segments_.reserve(wanted + 1);
+        while (segments() < wanted)
+        {
+            add_segment();
+            prefault(segments_[segments() - 1], pool_access::chunk_size(*pool_));
+        }
+    }
+
+    void pop_back()
+    {
+        assert(size_);
+        --size_;
+        (*this)[size_].~T();
+        release_unused(1);
+    }
+
+    void clear()
+    {
+        while (size_)
+        {
+            --size_;
+            (*this)[size_].~T();
+        }
+    }
+
+    // returns every segment past size() to the pool
+    void shrink_to_fit() { release_unused(0); }
+
+    T &operator[](size_t pos) { return segments_[pos / def_size][pos % def_size]; }
+    const T &operator[](size_t pos) const { return segments_[pos / def_size][pos % def_size]; }
+
+    T &at(size_t pos)
+    {
+        if (pos < size_) return (*this)[pos];
+        throw std::out_of_range("Out of bounds element access");
+    }
+
+    T &back() { return (*this)[size_ - 1]; }
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    size_t capacity() const { return (segments_.size() - 1) * def_size; }
+    size_t segments() const { return segments_.size() - 1; }
+
+    iterator begin() { return make_iterator<iterator>(0); }
+    iterator end() { return make_iterator<iterator>(size_); }
+    const_iterator begin() const { return make_iterator<const_iterator>(0); }
+    const_iterator end() const { return make_iterator<const_iterator>(size_); }
+
+private:
+    // the index always ends with a null entry, iterators step onto it at the end
+    void init_index()
+    {
+        segments_.clear();
+        segments_.push_back(nullptr);
+    }
+
+    void add_segment()
+    {
+        void *mem = pool_->malloc();
+        if (!mem)
+            throw std::bad_alloc();
+        segments_.back() = static_cast<T *>(mem);
+        try
+        {
+            segments_.push_back(nullptr);
+        }
+        catch (...)
+        {
+            segments_.back() = nullptr;
+            pool_->free(mem);
+            throw;
+        }
+    }
+
+    // frees trailing segments while more than spare of them are unused
+    void release_unused(size_t spare)
+    {
+        const size_t used = (size_ + def_size - 1) / def_size;
+        while (segments() > used + spare)
+        {
+            segments_.pop_back();
+            pool_->free(segments_.back());
+            segments_.back() = nullptr;
+        }
+    }
+
+    template <class It>
+    It make_iterator(size_t pos) const
+    {
+        return It(&segments_[pos / def_size], segments_[pos / def_size] + pos % def_size);
+    }
+
+    std::unique_ptr<Pool> own_;
+    Pool *pool_;
+    std::vector<T *> segments_;
+    size_t size_ = 0;
+};
@@ -0,0 +1,225 @@
+#include "my_pool_alloc.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+// every heap allocation of the process, to show what reuse saves
+static std::size_t heap_allocations = 0;
+
+void *operator new(std::size_t sz)
+{
+    ++heap_allocations;
+    if (sz == 0)
+        ++sz; // avoid std::malloc(0) which may return nullptr on success
+
+    if (void *ptr = std::malloc(sz))
+        return ptr;
+
+    throw std::bad_alloc{};
+}
+
+void operator delete(void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+// parsed request as a server keeps it while handling it
+struct request
+{
+    std::string method;
+    std::string path;
+    std::vector<std::pair<std::string, std::string>> headers;
+    std::size_t header_count = 0;
+    std::string body;
+
+    // reuses a header slot of an earlier request together with its strings
+    void add_header(const std::string &name, const std::string &value)
+    {
+        if (header_count == headers.size())
+            headers.emplace_back();
+        headers[header_count].first.assign(name);
+        headers[header_count].second.assign(value);
+        ++header_count;
+    }
+
+    // back to the state of a fresh request, every capacity stays
+    void reset()
+    {
+        method.clear();
+        path.clear();
+        header_count = 0;
+        body.clear();
+    }
+};
+
+struct sample
+{
+    std::string method;
+    std::string path;
+    std::vector<std::pair<std::string, std::string>> headers;
+    std::string body;
+};
+
+std::vector<sample> make_samples()
+{
+    std::vector<sample> samples;
+    for (int i{}; i != 16; ++i)
+    {
+        sample s;
+        s.method = i % 4 ? "GET" : "POST";
+        s.path = "/api/v1/customers/" + std::to_string(100'000 + i * 7) + "/orders?limit=" + std::to_string(10 * (i + 1));
+        s.headers = {{"Host", "orders.internal.example.com"},
+                     {"User-Agent", "order-client/3.14 (linux; x86_64)"},
+                     {"Accept", "application/json, text/plain;q=0.5"},
+                     {"Authorization", "Bearer " + std::string(48 + i, 'a' + i)},
+                     {"X-Request-Id", "5f2b1c44-" + std::to_string(i * 7919) + "-4e1a-9b0c-2f6d3a8e7c10"},
+                     {"Content-Type", "application/json; charset=utf-8"}};
+        for (int h{}; h != i % 5; ++h)
+        {
+            s.headers.emplace_back("X-Trace-Baggage-" + std::to_string(h), std::string(40, 'x'));
+        }
+        if (s.method == "POST")
+            s.body.assign(300 + 97 * i, '{');
+        samples.push_back(std::move(s));
+    }
+    return samples;
+}
+
+void parse(request &r, const sample &s)
+{
+    r.method.assign(s.method);
+    r.path.assign(s.path);
+    for (const auto &h : s.headers)
+    {
+        r.add_header(h.first, h.second);
+    }
+    r.body.assign(s.body);
+}
+
+std::size_t handle(const request &r)
+{
+    std::size_t bytes = r.method.size() + r.path.size() + r.body.size();
+    for (std::size_t i{}; i != r.header_count; ++i)
+    {
+        bytes += r.headers[i].first.size() + r.headers[i].second.size();
+    }
+    return bytes;
+}
+
+template <typename Func>
+auto benchmark(Func test_func, int iterations)
+{
+    const auto start = std::chrono::system_clock::now();
+    while (iterations-- > 0)
+    {
+        test_func();
+    }
+    const auto stop = std::chrono::system_clock::now();
+    const auto secs = std::chrono::duration<double>(stop - start);
+    return secs.count();
+}
+
+// up to this many requests are handled at the same time
+constexpr std::size_t in_flight{32};
+
+void test_churn()
+{
+    constexpr int iterations{1'000'000};
+    const auto samples = make_samples();
+    std::size_t bytes = 0;
+    std::size_t n = 0;
+
+    // t1: a new request object for every request
+    std::vector<std::unique_ptr<request>> slots1(in_flight);
+    std::size_t before = heap_allocations;
+    const double t1 = benchmark([&]
+                                {
+                                    auto &slot = slots1[n % in_flight];
+                                    slot = std::make_unique<request>();
+                                    parse(*slot, samples[n++ % samples.size()]);
+                                    bytes += handle(*slot); },
+                                iterations);
+    slots1.clear();
+    const std::size_t a1 = heap_allocations - before;
+
+    // t2: raw chunks reused through a Pool, the object is still built and torn down
+    Pool raw(sizeof(request));
+    auto pool_delete = [&raw](request *r)
+    {
+        r->~request();
+        raw.free(r);
+    };
+    std::vector<std::unique_ptr<request, decltype(pool_delete)>> slots2;
+    for (std::size_t i{}; i != in_flight; ++i)
+    {
+        slots2.emplace_back(nullptr, pool_delete);
+    }
+    before = heap_allocations;
+    const double t2 = benchmark([&]
+                                {
+                                    auto &slot = slots2[n % in_flight];
+                                    slot.reset();
+                                    slot.reset(::new (raw.malloc()) request());
+                                    parse(*slot, samples[n++ % samples.size()]);
+                                    bytes += handle(*slot); },
+                                iterations);
+    slots2.clear();
+    const std::size_t a2 = heap_allocations - before;
+
+    // t3: constructed objects come back reset, with their buffers
+    object_pool<request> objects;
+    std::vector<object_pool<request>::handle> slots3(in_flight);
+    before = heap_allocations;
+    const double t3 = benchmark([&]
+                                {
+                                    auto &slot = slots3[n % in_flight];
+                                    slot.reset();
+                                    slot = objects.acquire();
+                                    parse(*slot, samples[n++ % samples.size()]);
+                                    bytes += handle(*slot); },
+                                iterations);
+    const std::size_t a3 = heap_allocations - before;
+
+    // steady state: the same again once every cached object has seen the largest request
+    before = heap_allocations;
+    const double t4 = benchmark([&]
+                                {
+                                    auto &slot = slots3[n % in_flight];
+                                    slot.reset();
+                                    slot = objects.acquire();
+                                    parse(*slot, samples[n++ % samples.size()]);
+                                    bytes += handle(*slot); },
+                                iterations);
+    const std::size_t a4 = heap_allocations - before;
+    slots3.clear();
+
+    std::cout << std::fixed << "request churn, " << in_flight << " in flight:\n"
+              << "  t1 (make_unique per request):   " << t1 << " sec; heap allocs/request = "
+              << static_cast<double>(a1) / iterations << '\n'
+              << "  t2 (Pool chunks, constructed):  " << t2 << " sec; heap allocs/request = "
+              << static_cast<double>(a2) / iterations << '\n'
+              << "  t3 (object_pool, warming up):   " << t3 << " sec; heap allocs/request = "
+              << static_cast<double>(a3) / iterations << '\n'
+              << "  t4 (object_pool, steady state): " << t4 << " sec; heap allocs/request = "
+              << static_cast<double>(a4) / iterations << '\n'
+              << "  objects created = " << objects.created() << ", reused = " << objects.reused()
+              << ", cached = " << objects.cached() << "; checksum: " << bytes << '\n';
+}
+
+int main()
+{
+    test_churn();
+
+    return 0;
+}
@@ -0,0 +1,519 @@
+#include "my_pool_alloc.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Fork-join pool: every worker owns a task deque, runs its own tasks newest
+// first and steals the oldest task of another deque when its own is empty.
+// The thread that waits on a task_group runs tasks as well, so nested groups
+// cannot deadlock and size() threads do work. Slot 0 belongs to threads
+// outside the pool; one of them at a time should drive it.
+// Each slot has an arena, a monotonic resource only that slot allocates from,
+// for partial results that live until release_arenas().
+class work_stealing_pool
+{
+public:
+    using task = std::function<void()>;
+
+    explicit work_stealing_pool(unsigned threads = std::thread::hardware_concurrency())
+        : slots_(std::max(threads, 1u))
+    {
+        for (unsigned i = 1; i < slots_.size(); ++i)
+        {
+            workers_.emplace_back([this, i]
+                                  { work(i); });
+        }
+    }
+
+    work_stealing_pool(const work_stealing_pool &) = delete;
+    work_stealing_pool &operator=(const work_stealing_pool &) = delete;
+
+    ~work_stealing_pool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        for (auto &t : workers_)
+        {
+            t.join();
+        }
+    }
+
+    unsigned size() const { return static_cast<unsigned>(slots_.size()); }
+
+    void submit(task t)
+    {
+        // counted first, so the count never drops below the tasks in the deques
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+            ++queued_;
+        }
+        slot &s = slots_[current()];
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            s.tasks.push_back(std::move(t));
+        }
+        wake_.notify_one();
+    }
+
+    // runs one queued task on the calling thread, false when there was none
+    bool run_one()
+    {
+        const unsigned self = current();
+        task t;
+        for (unsigned k = 0; k != slots_.size() && !t; ++k)
+        {
+            slot &s = slots_[(self + k) % slots_.size()];
+            std::lock_guard<std::mutex> lock(s.mutex);
+            if (s.tasks.empty())
+                continue;
+            if (k == 0)
+            {
+                t = std::move(s.tasks.back());
+                s.tasks.pop_back();
+            }
+            else
+            {
+                t = std::move(s.tasks.front());
+                s.tasks.pop_front();
+                ++s.stolen;
+            }
+        }
+        if (!t)
+            return false;
+        queued_.fetch_sub(1, std::memory_order_relaxed);
+        t();
+        return true;
+    }
+
+    std::pmr::memory_resource *arena() { return &slots_[current()].arena; }
+
+    // only while no task runs
+    void release_arenas()
+    {
+        for (auto &s : slots_)
+        {
+            s.arena.release();
+        }
+    }
+
+    std::size_t steals() const
+    {
+        std::size_t n = 0;
+        for (auto &s : slots_)
+        {
+            n += s.stolen;
+        }
+        return n;
+    }
+
+private:
+    struct alignas(64) slot
+    {
+        std::mutex mutex;
+        std::deque<task> tasks;
+        std::size_t stolen = 0;
+        std::pmr::monotonic_buffer_resource arena;
+    };
+
+    unsigned current() const { return pool_of_thread == this ? slot_of_thread : 0; }
+
+    void work(unsigned index)
+    {
+        pool_of_thread = this;
+        slot_of_thread = index;
+        for (;;)
+        {
+            if (run_one())
+                continue;
+            std::unique_lock<std::mutex> lock(sleep_mutex_);
+            wake_.wait(lock, [this]
+                       { return stop_ || queued_.load(std::memory_order_relaxed) > 0; });
+            if (stop_)
+                return;
+        }
+    }
+
+    static thread_local const work_stealing_pool *pool_of_thread;
+    static thread_local unsigned slot_of_thread;
+
+    std::vector<slot> slots_;
+    std::vector<std::thread> workers_;
+    std::mutex sleep_mutex_;
+    std::condition_variable wake_;
+    std::atomic<std::size_t> queued_{0};
+    bool stop_ = false;
+};
+
+thread_local const work_stealing_pool *work_stealing_pool::pool_of_thread = nullptr;
+thread_local unsigned work_stealing_pool::slot_of_thread = 0;
+
+// Tasks forked from one place; wait() runs pool tasks until all of them are
+// done and rethrows the first exception one of them threw.
+class task_group
+{
+public:
+    explicit task_group(work_stealing_pool &pool) : pool_(pool) {}
+
+    task_group(const task_group &) = delete;
+    task_group &operator=(const task_group &) = delete;
+
+    ~task_group()
+    {
+        while (pending_.load(std::memory_order_acquire))
+        {
+            if (!pool_.run_one())
+                std::this_thread::yield();
+        }
+    }
+
+    template <class F>
+    void run(F f)
+    {
+        pending_.fetch_add(1, std::memory_order_relaxed);
+        pool_.submit([this, f = std::move(f)]
+                     {
+                         try
+                         {
+                             f();
+                         }
+                         catch (...)
+                         {
+                             std::lock_guard<std::mutex> lock(error_mutex_);
+                             if (!error_)
+                                 error_ = std::current_exception();
+                         }
+                         pending_.fetch_sub(1, std::memory_order_release); });
+    }
+
+    void wait()
+    {
+        while (pending_.load(std::memory_order_acquire))
+        {
+            if (!pool_.run_one())
+                std::this_thread::yield();
+        }
+        if (error_)
+            std::rethrow_exception(std::exchange(error_, nullptr));
+    }
+
+private:
+    work_stealing_pool &pool_;
+    std::atomic<std::size_t> pending_{0};
+    std::mutex error_mutex_;
+    std::exception_ptr error_;
+};
+
+// f(begin, end) over [0, n) in chunks of at least grain indices,
+// a few chunks per thread so that stealing can even out the load
+template <class F>
+void parallel_for(work_stealing_pool &pool, std::size_t n, std::size_t grain, F f)
+{
+    const std::size_t chunks = std::max<std::size_t>(1, std::min<std::size_t>(n / std::max<std::size_t>(grain, 1), pool.size() * 4));
+    if (chunks == 1)
+        return f(std::size_t{0}, n);
+    task_group group(pool);
+    for (std::size_t c = 0; c != chunks; ++c)
+    {
+        const std::size_t begin = n * c / chunks;
+        const std::size_t end = n * (c + 1) / chunks;
+        group.run([&f, begin, end]
+                  { f(begin, end); });
+    }
+    group.wait();
+}
+
+constexpr std::size_t default_grain{64 * 1024};
+
+// first[i] = gen(i)
+template <class RandomIt, class Gen>
+void parallel_generate(work_stealing_pool &pool, RandomIt first, std::size_t n, Gen gen)
+{
+    parallel_for(pool, n, default_grain, [&](std::size_t begin, std::size_t end)
+                 {
+                     for (std::size_t i = begin; i != end; ++i)
+                     {
+                         first[i] = gen(i);
+                     } });
+}
+
+template <class InIt, class OutIt, class Op>
+void parallel_transform(work_stealing_pool &pool, InIt first, InIt last, OutIt out, Op op)
+{
+    parallel_for(pool, static_cast<std::size_t>(last - first), default_grain, [&](std::size_t begin, std::size_t end)
+                 { std::transform(first + begin, first + end, out + begin, op); });
+}
+
+// Sample sort: splitters from a strided sample cut the input into 4 buckets
+// per thread, blocks of the input are counted and scattered into a scratch
+// buffer bucket by bucket, then every bucket is sorted and moved back by one
+// task. Elements are moved, not copied; T has to be default constructible.
+template <class RandomIt, class Compare = std::less<>>
+void parallel_sort(work_stealing_pool &pool, RandomIt first, RandomIt last, Compare comp = Compare())
+{
+    using T = typename std::iterator_traits<RandomIt>::value_type;
+    const std::size_t n = static_cast<std::size_t>(last - first);
+    const std::size_t buckets = pool.size() * 4;
+    if (pool.size() == 1 || n < buckets * default_grain)
+        return std::sort(first, last, comp);
+
+    constexpr std::size_t oversample = 64;
+    std::vector<T> sample;
+    sample.reserve(buckets * oversample);
+    for (std::size_t i = 0; i != buckets * oversample; ++i)
+    {
+        sample.push_back(first[i * (n / (buckets * oversample))]);
+    }
+    std::sort(sample.begin(), sample.end(), comp);
+    std::vector<T> splitters;
+    for (std::size_t b = 1; b != buckets; ++b)
+    {
+        splitters.push_back(sample[b * oversample]);
+    }
+    auto bucket_of = [&](const T &v)
+    { return static_cast<std::size_t>(std::upper_bound(splitters.begin(), splitters.end(), v, comp) - splitters.begin()); };
+
+    // block k covers [n * k / blocks, n * (k + 1) / blocks)
+    const std::size_t blocks = buckets;
+    std::vector<std::size_t> offsets(blocks * buckets);
+    {
+        task_group group(pool);
+        for (std::size_t k = 0; k != blocks; ++k)
+        {
+            group.run([&, k]
+                      {
+                          std::size_t *counts = &offsets[k * buckets];
+                          for (std::size_t i = n * k / blocks; i != n * (k + 1) / blocks; ++i)
+                          {
+                              ++counts[bucket_of(first[i])];
+                          } });
+        }
+        group.wait();
+    }
+
+    // bucket b starts at bounds[b]; inside it, the elements of block k follow those of block k - 1
+    std::vector<std::size_t> bounds(buckets + 1);
+    std::size_t pos = 0;
+    for (std::size_t b = 0; b != buckets; ++b)
+    {
+        bounds[b] = pos;
+        for (std::size_t k = 0; k != blocks; ++k)
+        {
+            pos += std::exchange(offsets[k * buckets + b], pos);
+        }
+    }
+    bounds[buckets] = n;
+
+    std::unique_ptr<T[]> scratch(new T[n]);
+    {
+        task_group group(pool);
+        for (std::size_t k = 0; k != blocks; ++k)
+        {
+            group.run([&, k]
+                      {
+                          std::size_t *next = &offsets[k * buckets];
+                          for (std::size_t i = n * k / blocks; i != n * (k + 1) / blocks; ++i)
+                          {
+                              scratch[next[bucket_of(first[i])]++] = std::move(first[i]);
+                          } });
+        }
+        group.wait();
+    }
+
+    task_group group(pool);
+    for (std::size_t b = 0; b != buckets; ++b)
+    {
+        group.run([&, b]
+                  {
+                      T *begin = scratch.get() + bounds[b];
+                      T *end = scratch.get() + bounds[b + 1];
+                      std::sort(begin, end, comp);
+                      std::move(begin, end, first + bounds[b]); });
+    }
+    group.wait();
+}
+
+// Fills an empty map with gen(0) .. gen(n - 1). Tasks generate and sort slices
+// of the entries in the arena of the thread running them, without touching
+// the map's allocator; the sorted slices are then merged into the map with an
+// end hint, an amortized constant-time insert. Of equal keys the entry from
+// the lowest slice wins. The arenas keep the slices until release_arenas().
+template <class Map, class Gen>
+void parallel_bulk_load(work_stealing_pool &pool, Map &map, std::size_t n, Gen gen)
+{
+    using entry = std::pair<typename Map::key_type, typename Map::mapped_type>;
+    using run = std::pmr::vector<entry>;
+    auto less = [&map](const entry &a, const entry &b)
+    { return map.key_comp()(a.first, b.first); };
+
+    const std::size_t slices = std::max<std::size_t>(1, std::min<std::size_t>(n / default_grain, pool.size() * 4));
+    std::vector<std::unique_ptr<run>> runs(slices);
+    {
+        task_group group(pool);
+        for (std::size_t s = 0; s != slices; ++s)
+        {
+            group.run([&, s]
+                      {
+                          auto r = std::make_unique<run>(pool.arena());
+                          r->reserve(n * (s + 1) / slices - n * s / slices);
+                          for (std::size_t i = n * s / slices; i != n * (s + 1) / slices; ++i)
+                          {
+                              r->push_back(gen(i));
+                          }
+                          std::stable_sort(r->begin(), r->end(), less);
+                          runs[s] = std::move(r); });
+        }
+        group.wait();
+    }
+
+    // k-way merge, the heap holds the next entry of every unfinished slice
+    using cursor = std::pair<std::size_t, std::size_t>; // slice, position
+    auto later = [&](const cursor &a, const cursor &b)
+    {
+        const entry &x = (*runs[a.first])[a.second];
+        const entry &y = (*runs[b.first])[b.second];
+        if (less(y, x))
+            return true;
+        return !less(x, y) && a.first > b.first;
+    };
+    std::priority_queue<cursor, std::vector<cursor>, decltype(later)> heads(later);
+    for (std::size_t s = 0; s != slices; ++s)
+    {
+        if (!runs[s]->empty())
+            heads.emplace(s, 0);
+    }
+    while (!heads.empty())
+    {
+        auto [s, i] = heads.top();
+        heads.pop();
+        entry &e = (*runs[s])[i];
+        map.emplace_hint(map.end(), std::move(e.first), std::move(e.second));
+        if (++i != runs[s]->size())
+            heads.emplace(s, i);
+    }
+}
+
+template <typename Func>
+auto benchmark(Func test_func, int iterations)
+{
+    const auto start = std::chrono::system_clock::now();
+    while (iterations-- > 0)
+    {
+        test_func();
+    }
+    const auto stop = std::chrono::system_clock::now();
+    const auto secs = std::chrono::duration<double>(stop - start);
+    return secs.count();
+}
+
+std::uint32_t mix(std::uint64_t i)
+{
+    i ^= i >> 33;
+    i *= 0xff51afd7ed558ccdULL;
+    i ^= i >> 33;
+    return static_cast<std::uint32_t>(i);
+}
+
+struct timings
+{
+    double fill = 0;
+    double transform = 0;
+    double sort = 0;
+    double pool_map = 0;
+    double pmr_map = 0;
+};
+
+using pool_map = std::map<std::uint32_t, std::uint32_t, std::less<std::uint32_t>,
+                          my_pool_alloc<std::pair<const std::uint32_t, std::uint32_t>>>;
+
+timings run(unsigned threads, std::size_t n, std::size_t map_n)
+{
+    work_stealing_pool pool(threads);
+    timings t;
+
+    my_vector<std::uint32_t> v;
+    v.resize(n);
+    t.fill = benchmark([&]
+                       { parallel_generate(pool, v.begin(), n, [](std::size_t i)
+                                           { return mix(i); }); },
+                       1);
+    t.transform = benchmark([&]
+                            { parallel_transform(pool, v.begin(), v.end(), v.begin(), [](std::uint32_t x)
+                                                 { return x * 2654435761u + 1; }); },
+                            1);
+    t.sort = benchmark([&]
+                       { parallel_sort(pool, v.begin(), v.end()); },
+                       1);
+    if (!std::is_sorted(v.begin(), v.end()))
+        std::cout << "  not sorted!\n";
+
+    auto key = [map_n](std::size_t i)
+    { return std::pair<std::uint32_t, std::uint32_t>(mix(i) % (map_n * 4), static_cast<std::uint32_t>(i)); };
+    {
+        // chunks fit one rb-tree node: three pointers, the color and the pair;
+        // one block for all nodes, the map frees them in falling address order
+        // then, and ordered_free finds its place at the head of the free list
+        Pool nodes(64, map_n);
+        pool_map m{my_pool_alloc<std::pair<const std::uint32_t, std::uint32_t>>(nodes)};
+        t.pool_map = benchmark([&]
+                               { parallel_bulk_load(pool, m, map_n, key); },
+                               1);
+        pool.release_arenas();
+    }
+    {
+        std::pmr::unsynchronized_pool_resource nodes;
+        std::pmr::map<std::uint32_t, std::uint32_t> m(&nodes);
+        t.pmr_map = benchmark([&]
+                              { parallel_bulk_load(pool, m, map_n, key); },
+                              1);
+        pool.release_arenas();
+    }
+    return t;
+}
+
+// usage: 20_parallel_build [elements [max threads]]
+int main(int argc, char *argv[])
+{
+    const std::size_t n = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 100'000'000;
+    const unsigned max_threads = argc > 2 ? static_cast<unsigned>(std::atoi(argv[2]))
+                                          : std::max(1u, std::thread::hardware_concurrency());
+    // a node per element would not fit in memory next to the vector
+    const std::size_t map_n = n / 10;
+
+    std::cout << std::fixed << n << " uint32 in a my_vector, " << map_n << " map entries:\n";
+    timings base;
+    for (unsigned threads = 1;; threads = std::min(threads * 2, max_threads))
+    {
+        const timings t = run(threads, n, map_n);
+        if (threads == 1)
+            base = t;
+        std::cout << "  " << threads << " thread(s): fill " << t.fill << " sec (x" << base.fill / t.fill
+                  << "), transform " << t.transform << " sec (x" << base.transform / t.transform
+                  << "), sort " << t.sort << " sec (x" << base.sort / t.sort
+                  << "), map with my_pool_alloc " << t.pool_map << " sec (x" << base.pool_map / t.pool_map
+                  << "), pmr map " << t.pmr_map << " sec (x" << base.pmr_map / t.pmr_map << ")\n";
+        if (threads == max_threads)
+            break;
+    }
+
+    return 0;
+}
@@ -4,6 +4,13 @@
 #include <memory_resource>
 #include <array>
 #include <list>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <thread>
 
 namespace motivation
 {
@@ -112,24 +119,24 @@ namespace solution
 
         MyResource() = default;
 
-        void *do_allocate(size_t n, size_t) override
+        // n is already in bytes, the container multiplied it by sizeof(value_type)
+        void *do_allocate(size_t n, size_t align) override
         {
-            std::cout << "allocate from my resource" << std::endl;
-            auto p = std::malloc(n * sizeof(T));
-            if (!p)
-                throw std::bad_alloc();
-            return p;
+            ++allocations;
+            return ::operator new(n, std::align_val_t(align));
         }
 
-        void do_deallocate(void *p, size_t, size_t) override
+        void do_deallocate(void *p, size_t n, size_t align) override
         {
-            std::free(p);
+            ::operator delete(p, n, std::align_val_t(align));
         }
 
         bool do_is_equal(const std::pmr::memory_resource &) const noexcept override
         {
             return true;
         }
+
+        size_t allocations = 0;
     };
 
     // pmr::vector??
@@ -162,9 +169,417 @@ namespace solution
         std::pmr::vector<int> values3{10, 9, 8, 7, 6, 5};
         values1 = values3; // Ok
         values1 = values2; // Ok
+
+        // values4 took the default resource, only values2 allocates from myResource
+        std::cout << "allocations from my resource: " << myResource.allocations << std::endl;
     }
 }
 
+namespace pooling
+{
+
+    // Segregated size-class pool with per-thread caches.
+    // Small requests are served from a free list of the calling thread without
+    // any locking. An empty cache takes a batch of blocks from the shared list of
+    // its class, an overfull one gives a batch back, so the class mutex is taken
+    // once per batch. Slabs come from the upstream. Blocks given back to a class
+    // go onto the free list of their own slab, kept in a header at the slab's
+    // end, and the slabs with free blocks are linked per class. Once more than
+    // max_free_slabs of a class are entirely free the class hands all but
+    // keep_free_slabs of them back in one go; release() returns the rest.
+    // Blocks are carved at multiples of their size from slab-aligned slabs, so a
+    // request rounded up to a multiple of its alignment is always aligned, and a
+    // block finds its slab header by masking.
+    // Each thread remembers which caches it owns; entries of destroyed resources
+    // are dropped on the next lookup miss after a resource dies. When the thread
+    // exits, its caches give their blocks to the shared lists and are freed.
+    class size_class_resource : public std::pmr::memory_resource
+    {
+    public:
+        static constexpr size_t granularity = 16;
+        static constexpr size_t max_small = 1024;
+        static constexpr size_t num_classes = max_small / granularity;
+        static constexpr size_t slab_size = 64 * 1024;
+        static constexpr size_t slab_align = slab_size;
+        static constexpr size_t batch = 32;
+        static constexpr size_t max_free_slabs = 16;
+        static constexpr size_t keep_free_slabs = 4;
+
+        explicit size_class_resource(std::pmr::memory_resource *upstream = std::pmr::get_default_resource())
+            : upstream_(upstream), id_(register_id())
+        {
+        }
+
+        size_class_resource(const size_class_resource &) = delete;
+        size_class_resource &operator=(const size_class_resource &) = delete;
+
+        ~size_class_resource() override
+        {
+            // once unregistered, no exiting thread retires a cache of ours
+            unregister_id(id_);
+            release();
+        }
+
+        // gives every slab back, all blocks must be free by now
+        void release()
+        {
+            std::lock_guard<std::mutex> lock(slabs_mutex_);
+            for (void *slab : slabs_)
+            {
+                upstream_->deallocate(slab, slab_size, slab_align);
+            }
+            slabs_.clear();
+            for (auto &c : central_)
+            {
+                c.partial = nullptr;
+                c.bump = c.bump_end = nullptr;
+                c.free_slabs = 0;
+            }
+            for (auto &cache : caches_)
+            {
+                *cache = thread_cache{};
+            }
+        }
+
+        size_t slabs() const
+        {
+            std::lock_guard<std::mutex> lock(slabs_mutex_);
+            return slabs_.size();
+        }
+
+    private:
+        struct block
+        {
+            block *next;
+        };
+
+        struct free_list
+        {
+            block *head = nullptr;
+            size_t count = 0;
+        };
+
+        struct thread_cache
+        {
+            free_list lists[num_classes];
+        };
+
+        // at the end of every slab
+        struct slab_header
+        {
+            block *free = nullptr; // blocks of this slab given back to the class
+            size_t count = 0;
+            slab_header *prev = nullptr; // in the partial list of the class
+            slab_header *next = nullptr;
+            bool listed = false;
+        };
+
+        struct alignas(64) central_list
+        {
+            std::mutex m;
+            slab_header *partial = nullptr; // slabs with free blocks
+            char *bump = nullptr;
+            char *bump_end = nullptr;
+            size_t free_slabs = 0; // slabs whose blocks are all free
+        };
+
+        struct tls_entry
+        {
+            std::uint64_t id;
+            size_class_resource *owner;
+            thread_cache *cache;
+        };
+
+        // the caches of one thread, retired when it exits
+        struct owned_caches
+        {
+            std::vector<tls_entry> entries;
+
+            ~owned_caches()
+            {
+                last_ = tls_entry{0, nullptr, nullptr};
+                exiting_ = true;
+                std::lock_guard<std::mutex> lock(registry_mutex_);
+                for (auto &e : entries)
+                {
+                    if (std::binary_search(live_ids_.begin(), live_ids_.end(), e.id))
+                        e.owner->retire(e.cache);
+                }
+            }
+        };
+
+        static size_t class_of(size_t bytes, size_t align)
+        {
+            if (align > granularity)
+                bytes = (bytes + align - 1) & ~(align - 1);
+            return bytes ? (bytes - 1) / granularity : 0;
+        }
+
+        static size_t block_size(size_t cls)
+        {
+            return (cls + 1) * granularity;
+        }
+
+        static constexpr size_t slab_space = slab_size - sizeof(slab_header);
+
+        static size_t blocks_per_slab(size_t cls)
+        {
+            return slab_space / block_size(cls);
+        }
+
+        static char *slab_of(const void *p)
+        {
+            return reinterpret_cast<char *>(reinterpret_cast<std::uintptr_t>(p) & ~(slab_size - 1));
+        }
+
+        static slab_header &header_of(const void *p)
+        {
+            return *reinterpret_cast<slab_header *>(slab_of(p) + slab_space);
+        }
+
+        thread_cache &local()
+        {
+            if (last_.id == id_)
+                return *last_.cache;
+
+            // deallocations from destructors that run after the thread's caches
+            // were retired get a cache that stays until release()
+            if (exiting_)
+            {
+                std::lock_guard<std::mutex> lock(slabs_mutex_);
+                caches_.push_back(std::make_unique<thread_cache>());
+                last_ = tls_entry{id_, this, caches_.back().get()};
+                return *last_.cache;
+            }
+
+            // ids are never reused, so entries of destroyed resources never match,
+            // they are pruned once some resource has died since the last lookup
+            thread_local owned_caches owned;
+            std::vector<tls_entry> &known = owned.entries;
+            thread_local std::uint64_t pruned_at = 0;
+            const std::uint64_t generation = generation_.load(std::memory_order_acquire);
+            if (generation != pruned_at)
+            {
+                std::lock_guard<std::mutex> lock(registry_mutex_);
+                known.erase(std::remove_if(known.begin(), known.end(), [](const tls_entry &e)
+                                           { return !std::binary_search(live_ids_.begin(), live_ids_.end(), e.id); }),
+                            known.end());
+                pruned_at = generation;
+            }
+            for (auto &e : known)
+            {
+                if (e.id == id_)
+                {
+                    last_ = e;
+                    return *e.cache;
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(slabs_mutex_);
+            caches_.push_back(std::make_unique<thread_cache>());
+            last_ = tls_entry{id_, this, caches_.back().get()};
+            known.push_back(last_);
+            return *last_.cache;
+        }
+
+        // under the registry mutex, from the exiting thread that owns the cache
+        void retire(thread_cache *cache)
+        {
+            for (size_t cls = 0; cls != num_classes; ++cls)
+            {
+                free_list &list = cache->lists[cls];
+                if (list.count)
+                    drain(list, cls, list.count);
+            }
+            std::lock_guard<std::mutex> lock(slabs_mutex_);
+            caches_.erase(std::find_if(caches_.begin(), caches_.end(), [cache](const auto &c)
+                                       { return c.get() == cache; }));
+        }
+
+        void *new_slab()
+        {
+            std::lock_guard<std::mutex> lock(slabs_mutex_);
+            void *slab = upstream_->allocate(slab_size, slab_align);
+            slabs_.push_back(slab);
+            return slab;
+        }
+
+        static void unlink(central_list &c, slab_header &h)
+        {
+            (h.prev ? h.prev->next : c.partial) = h.next;
+            if (h.next)
+                h.next->prev = h.prev;
+            h.prev = h.next = nullptr;
+            h.listed = false;
+        }
+
+        void refill(free_list &list, size_t cls)
+        {
+            central_list &c = central_[cls];
+            const size_t size = block_size(cls);
+            const size_t per_slab = blocks_per_slab(cls);
+            std::lock_guard<std::mutex> lock(c.m);
+            while (list.count < batch)
+            {
+                block *b;
+                if (slab_header *h = c.partial)
+                {
+                    if (h->count-- == per_slab)
+                        --c.free_slabs;
+                    b = h->free;
+                    h->free = b->next;
+                    if (!h->free)
+                        unlink(c, *h);
+                }
+                else
+                {
+                    if (!c.bump || c.bump + size > c.bump_end)
+                    {
+                        c.bump = static_cast<char *>(new_slab());
+                        c.bump_end = c.bump + slab_space;
+                        ::new (c.bump_end) slab_header;
+                    }
+                    b = reinterpret_cast<block *>(c.bump);
+                    c.bump += size;
+                }
+                b->next = list.head;
+                list.head = b;
+                ++list.count;
+            }
+        }
+
+        void drain(free_list &list, size_t cls, size_t n)
+        {
+            central_list &c = central_[cls];
+            const size_t per_slab = blocks_per_slab(cls);
+            std::lock_guard<std::mutex> lock(c.m);
+            for (size_t i = 0; i != n; ++i)
+            {
+                block *b = list.head;
+                list.head = b->next;
+                slab_header &h = header_of(b);
+                b->next = h.free;
+                h.free = b;
+                if (++h.count == per_slab)
+                    ++c.free_slabs;
+                if (!h.listed)
+                {
+                    h.next = c.partial;
+                    if (h.next)
+                        h.next->prev = &h;
+                    c.partial = &h;
+                    h.listed = true;
+                }
+            }
+            list.count -= n;
+            if (c.free_slabs > max_free_slabs)
+                return_free_slabs(c, cls);
+        }
+
+        // under the class mutex: takes all but keep_free_slabs entirely free
+        // slabs off the partial list and gives them to the upstream together
+        void return_free_slabs(central_list &c, size_t cls)
+        {
+            const size_t per_slab = blocks_per_slab(cls);
+            std::vector<char *> victims;
+            size_t kept = 0;
+            for (slab_header *h = c.partial; h;)
+            {
+                slab_header *next = h->next;
+                if (h->count == per_slab && kept++ >= keep_free_slabs)
+                {
+                    unlink(c, *h);
+                    victims.push_back(slab_of(h));
+                }
+                h = next;
+            }
+            c.free_slabs = keep_free_slabs;
+            if (c.bump && std::find(victims.begin(), victims.end(), slab_of(c.bump - 1)) != victims.end())
+                c.bump = c.bump_end = nullptr;
+
+            std::lock_guard<std::mutex> lock(slabs_mutex_);
+            for (char *slab : victims)
+            {
+                upstream_->deallocate(slab, slab_size, slab_align);
+                auto it = std::find(slabs_.begin(), slabs_.end(), slab);
+                *it = slabs_.back();
+                slabs_.pop_back();
+            }
+        }
+
+        void *do_allocate(size_t bytes, size_t align) override
+        {
+            if (bytes > max_small || align > max_small)
+                return upstream_->allocate(bytes, align);
+
+            const size_t cls = class_of(bytes, align);
+            if (cls >= num_classes)
+                return upstream_->allocate(bytes, align);
+
+            free_list &list = local().lists[cls];
+            if (!list.head)
+                refill(list, cls);
+            block *b = list.head;
+            list.head = b->next;
+            --list.count;
+            return b;
+        }
+
+        void do_deallocate(void *p, size_t bytes, size_t align) override
+        {
+            const size_t cls = class_of(bytes, align);
+            if (bytes > max_small || align > max_small || cls >= num_classes)
+            {
+                upstream_->deallocate(p, bytes, align);
+                return;
+            }
+
+            free_list &list = local().lists[cls];
+            auto *b = static_cast<block *>(p);
+            b->next = list.head;
+            list.head = b;
+            if (++list.count >= 2 * batch)
+                drain(list, cls, batch);
+        }
+
+        bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+        {
+            return this == &other;
+        }
+
+        // ids are handed out in increasing order, so live_ids_ stays sorted
+        static std::uint64_t register_id()
+        {
+            std::lock_guard<std::mutex> lock(registry_mutex_);
+            live_ids_.push_back(next_id_++);
+            return live_ids_.back();
+        }
+
+        static void unregister_id(std::uint64_t id)
+        {
+            {
+                std::lock_guard<std::mutex> lock(registry_mutex_);
+                live_ids_.erase(std::lower_bound(live_ids_.begin(), live_ids_.end(), id));
+            }
+            generation_.fetch_add(1, std::memory_order_release);
+        }
+
+        static inline std::mutex registry_mutex_;
+        static inline std::uint64_t next_id_ = 1;
+        static inline std::vector<std::uint64_t> live_ids_;
+        static inline std::atomic<std::uint64_t> generation_{0};
+        static inline thread_local tls_entry last_{0, nullptr, nullptr};
+        static inline thread_local bool exiting_ = false;
+
+        std::pmr::memory_resource *upstream_;
+        const std::uint64_t id_;
+        central_list central_[num_classes];
+        mutable std::mutex slabs_mutex_;
+        std::vector<void *> slabs_;
+        std::vector<std::unique_ptr<thread_cache>> caches_;
+    };
+}
+
 template <typename Func>
 auto benchmark(Func test_func, int iterations)
 {
@@ -181,7 +596,7 @@ auto benchmark(Func test_func, int iterations)
 void test_allocs()
 {
     constexpr int iterations{100};
-    constexpr int total_nodes{2'00'000};
+    constexpr int total_nodes{200'000};
 
     auto default_std_alloc = [total_nodes]
     {
@@ -215,14 +630,100 @@ void test_allocs()
         }
     };
 
+    // the pools live across iterations, as they would in a service
+    auto pmr_pool_alloc = [total_nodes](std::pmr::memory_resource *res)
+    {
+        return [total_nodes, res]
+        {
+            std::pmr::list<int> list{res};
+            for (int i{}; i != total_nodes; ++i)
+            {
+                list.push_back(i);
+            }
+        };
+    };
+
+    std::pmr::synchronized_pool_resource sync_pool;
+    std::pmr::unsynchronized_pool_resource unsync_pool;
+    pooling::size_class_resource size_class_pool;
+
     const double t1 = benchmark(default_std_alloc, iterations);
     const double t2 = benchmark(default_pmr_alloc, iterations);
     const double t3 = benchmark(pmr_alloc_and_buf, iterations);
+    const double t4 = benchmark(pmr_pool_alloc(&sync_pool), iterations);
+    const double t5 = benchmark(pmr_pool_alloc(&unsync_pool), iterations);
+    const double t6 = benchmark(pmr_pool_alloc(&size_class_pool), iterations);
 
     std::cout << std::fixed
               << "t1 (default std alloc): " << t1 << " sec;" << '\n'
               << "t2 (default pmr alloc): " << t2 << " sec;" << '\n'
-              << "t3 (pmr alloc buf): " << t3 << " sec;" << '\n';
+              << "t3 (pmr alloc buf): " << t3 << " sec;" << '\n'
+              << "t4 (pmr sync pool): " << t4 << " sec;" << '\n'
+              << "t5 (pmr unsync pool): " << t5 << " sec;" << '\n'
+              << "t6 (pmr size class pool): " << t6 << " sec;" << '\n';
+}
+
+// the same list and string workloads from several threads sharing one resource
+void test_contention()
+{
+    constexpr int iterations{10};
+    constexpr int total_nodes{200'000};
+    const unsigned threads = std::max(4u, std::thread::hardware_concurrency());
+
+    auto workload = [total_nodes](std::pmr::memory_resource *res)
+    {
+        std::pmr::list<int> list{res};
+        std::pmr::vector<std::pmr::string> container{res};
+        for (int i{}; i != total_nodes; ++i)
+        {
+            list.push_back(i);
+            if (i % 8 == 0)
+                container.emplace_back("a key long enough to leave the SSO buffer");
+        }
+    };
+
+    auto run = [&](std::pmr::memory_resource *shared)
+    {
+        return benchmark([&]
+                         {
+                             std::vector<std::thread> workers;
+                             for (unsigned t = 0; t != threads; ++t)
+                             {
+                                 workers.emplace_back(workload, shared);
+                             }
+                             for (auto &w : workers)
+                             {
+                                 w.join();
+                             } },
+                         iterations);
+    };
+
+    std::pmr::synchronized_pool_resource sync_pool;
+    pooling::size_class_resource size_class_pool;
+
+    // unsynchronized_pool_resource cannot be shared, every thread gets its own
+    const double t_unsync = benchmark([&]
+                                      {
+                                          std::vector<std::thread> workers;
+                                          for (unsigned t = 0; t != threads; ++t)
+                                          {
+                                              workers.emplace_back([&]
+                                                                   {
+                                                                       std::pmr::unsynchronized_pool_resource own;
+                                                                       workload(&own); });
+                                          }
+                                          for (auto &w : workers)
+                                          {
+                                              w.join();
+                                          } },
+                                      iterations);
+    const double t_sync = run(&sync_pool);
+    const double t_size_class = run(&size_class_pool);
+
+    std::cout << std::fixed << threads << " threads:" << '\n'
+              << "t7 (pmr sync pool, shared): " << t_sync << " sec;" << '\n'
+              << "t8 (pmr unsync pool, per thread): " << t_unsync << " sec;" << '\n'
+              << "t9 (pmr size class pool, shared): " << t_size_class << " sec;" << '\n';
 }
 
 int main()
@@ -257,6 +758,7 @@ int main()
     std::pmr::vector<int> v4(v2, &unsync_pool);
 
     test_allocs();
+    test_contention();
     solution::someFunction();
 
     return 0;
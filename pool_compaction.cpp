@@ -0,0 +1,153 @@
+#include "my_pool_alloc.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+using pool_vector = my_vector<int, my_pool_alloc<int>>;
+
+constexpr int rounds{30};
+constexpr int temporaries_per_round{600};
+constexpr int min_lifetime{4};
+constexpr int max_lifetime{12};
+
+long rss_kb()
+{
+    long pages = 0;
+    long resident = 0;
+    FILE *f = std::fopen("/proc/self/statm", "r");
+    if (!f)
+        return -1;
+    if (std::fscanf(f, "%ld %ld", &pages, &resident) != 2)
+        resident = -1;
+    std::fclose(f);
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+void print_stats(int round, const pool_stats &st, double secs)
+{
+    std::cout << "round " << round
+              << ": blocks = " << st.blocks
+              << ", pool = " << (st.block_bytes >> 10) << " kB"
+              << ", free chunks = " << st.free_chunks << " in " << st.free_runs << " runs"
+              << ", largest run = " << st.largest_free_run
+              << ", fragmentation = " << st.fragmentation()
+              << ", rss = " << rss_kb() << " kB"
+              << ", " << secs << " sec" << std::endl;
+}
+
+void print_histogram(const pool_stats &st)
+{
+    std::cout << "free run lengths:";
+    for (size_t k = 0; k < st.run_histogram.size(); ++k)
+    {
+        if (st.run_histogram[k])
+            std::cout << " [" << (size_t{1} << k) << ".." << (size_t{2} << k) - 1 << "]=" << st.run_histogram[k];
+    }
+    std::cout << std::endl;
+}
+
+// Each round builds temporary buffers of mixed sizes, the sizes drifting
+// upwards from round to round, and behind every temporary a small survivor that
+// lives for several rounds. When the temporaries die, the survivors pin every
+// block and leave only holes of last round's sizes, too short for this round's
+// ordered_malloc(n), so without compaction the pool keeps adding blocks.
+// Compaction moves the survivors down into the first blocks and
+// release_memory() gives the emptied ones back.
+struct churn_result
+{
+    size_t blocks;
+    size_t pool_kb;
+    long rss_kb;
+};
+
+churn_result churn(bool compact)
+{
+    // bounded block growth, as a long-running service would configure it
+    Pool pool(sizeof(int), 1024, 16 * 1024);
+    my_pool_alloc<int> alloc(pool);
+
+    struct survivor
+    {
+        pool_vector v;
+        int dies;
+    };
+    std::vector<survivor> survivors;
+    std::vector<pool_vector> temporaries;
+    temporaries.reserve(temporaries_per_round);
+
+    std::mt19937 gen(7);
+    std::uniform_int_distribution<int> lifetime(min_lifetime, max_lifetime);
+    std::uniform_int_distribution<size_t> small(4, 16);
+
+    std::cout << (compact ? "with compaction:" : "without compaction:") << std::endl;
+    pool_stats st;
+    for (int round{1}; round <= rounds; ++round)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        const size_t base = 64 + 16 * static_cast<size_t>(round);
+        std::uniform_int_distribution<size_t> mixed(base, 2 * base);
+        for (int i{}; i != temporaries_per_round; ++i)
+        {
+            temporaries.emplace_back(alloc).resize(mixed(gen));
+            survivors.push_back({pool_vector(alloc), round + lifetime(gen)});
+            survivors.back().v.resize(small(gen));
+        }
+        temporaries.clear();
+        survivors.erase(std::remove_if(survivors.begin(), survivors.end(), [round](const survivor &s)
+                                       { return s.dies == round; }),
+                        survivors.end());
+
+        if (compact)
+        {
+            for (auto &s : survivors)
+            {
+                s.v.compact();
+            }
+            pool.release_memory();
+        }
+        const auto stop = std::chrono::steady_clock::now();
+
+        st = inspect_pool(pool);
+        if (round % 5 == 0)
+            print_stats(round, st, std::chrono::duration<double>(stop - start).count());
+    }
+    print_histogram(st);
+    return {st.blocks, st.block_bytes >> 10, rss_kb()};
+}
+
+int main()
+{
+    // each mode in its own process, so the RSS of one does not leak into the other
+    int results[2];
+    if (::pipe(results) != 0)
+        return 1;
+    churn_result r[2]{};
+    for (bool compact : {false, true})
+    {
+        std::cout.flush();
+        if (::fork() == 0)
+        {
+            const churn_result mine = churn(compact);
+            std::cout.flush();
+            const bool sent = ::write(results[1], &mine, sizeof(mine)) == static_cast<ssize_t>(sizeof(mine));
+            ::_exit(sent ? 0 : 1);
+        }
+        ::wait(nullptr);
+        if (::read(results[0], &r[compact], sizeof(churn_result)) != static_cast<ssize_t>(sizeof(churn_result)))
+            return 1;
+    }
+
+    std::cout << "after " << rounds << " rounds: blocks = " << r[0].blocks << " vs " << r[1].blocks
+              << ", pool = " << r[0].pool_kb << " kB vs " << r[1].pool_kb << " kB"
+              << ", rss = " << r[0].rss_kb << " kB vs " << r[1].rss_kb << " kB"
+              << " (without vs with compaction)" << std::endl;
+
+    return 0;
+}
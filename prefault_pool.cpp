@@ -0,0 +1,354 @@
+#include "my_pool_alloc.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+#include <sys/mman.h>
+
+// Fixed-size chunks for pmr containers, carved from slabs mapped with
+// MAP_POPULATE, so a chunk handed out never takes a page fault. Requests
+// bigger than a chunk go upstream. reserve(n) maps slabs until n chunks are
+// free; keep_headroom(n) starts a thread that maps slabs in the background
+// whenever allocations take the free list below n / 2 and tops it up to n.
+// The allocating thread maps a slab itself only when the free list runs dry,
+// that is when a burst outruns the headroom. Thread safe, the free list is
+// behind a mutex. Slabs are unmapped only when the resource is destroyed.
+class headroom_resource : public std::pmr::memory_resource
+{
+public:
+    explicit headroom_resource(std::size_t chunk_size, std::size_t slab_chunks = 4096,
+                               std::pmr::memory_resource *upstream = std::pmr::get_default_resource())
+        : chunk_(round_up(std::max(chunk_size, sizeof(free_chunk)), alignof(std::max_align_t))),
+          slab_chunks_(slab_chunks), upstream_(upstream)
+    {
+    }
+
+    headroom_resource(const headroom_resource &) = delete;
+    headroom_resource &operator=(const headroom_resource &) = delete;
+
+    ~headroom_resource() override
+    {
+        stop_headroom();
+        for (void *slab : slabs_)
+        {
+            ::munmap(slab, slab_bytes());
+        }
+    }
+
+    // maps slabs on the calling thread until at least n chunks are free
+    void reserve(std::size_t n)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (free_count_ < n)
+        {
+            lock.unlock();
+            void *slab = map_slab();
+            lock.lock();
+            add_slab(slab);
+        }
+    }
+
+    void keep_headroom(std::size_t n)
+    {
+        stop_headroom();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            headroom_ = n;
+            stop_ = false;
+        }
+        refill_ = std::thread([this]
+                              { refill(); });
+    }
+
+    void stop_headroom()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+            headroom_ = 0;
+        }
+        wake_.notify_one();
+        if (refill_.joinable())
+            refill_.join();
+    }
+
+    std::size_t chunk_size() const { return chunk_; }
+
+    std::size_t free_chunks() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return free_count_;
+    }
+
+    // slabs an allocating thread had to map itself, each one a stall
+    std::size_t inline_maps() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return inline_maps_;
+    }
+
+    // times the background thread could not map a slab and gave up
+    std::size_t refill_failures() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return refill_failures_;
+    }
+
+private:
+    struct free_chunk
+    {
+        free_chunk *next;
+    };
+
+    static std::size_t round_up(std::size_t n, std::size_t to) { return (n + to - 1) / to * to; }
+
+    std::size_t slab_bytes() const { return chunk_ * slab_chunks_; }
+
+    void *map_slab()
+    {
+        void *p = ::mmap(nullptr, slab_bytes(), PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+        if (p == MAP_FAILED)
+            throw std::bad_alloc();
+        return p;
+    }
+
+    // under mutex_
+    void add_slab(void *slab)
+    {
+        try
+        {
+            slabs_.push_back(slab);
+        }
+        catch (...)
+        {
+            ::munmap(slab, slab_bytes());
+            throw;
+        }
+        char *c = static_cast<char *>(slab);
+        for (std::size_t i = slab_chunks_; i-- > 0;)
+        {
+            auto *f = ::new (c + i * chunk_) free_chunk{free_};
+            free_ = f;
+        }
+        free_count_ += slab_chunks_;
+    }
+
+    void refill()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;)
+        {
+            wake_.wait(lock, [this]
+                       { return stop_ || free_count_ < headroom_ / 2; });
+            if (stop_)
+                return;
+            while (!stop_ && free_count_ < headroom_)
+            {
+                lock.unlock();
+                try
+                {
+                    void *slab = map_slab();
+                    lock.lock();
+                    add_slab(slab);
+                }
+                catch (const std::bad_alloc &)
+                {
+                    // out of memory: stop keeping headroom until keep_headroom()
+                    // is called again, allocating threads map inline meanwhile
+                    if (!lock.owns_lock())
+                        lock.lock();
+                    ++refill_failures_;
+                    headroom_ = 0;
+                }
+            }
+        }
+    }
+
+    void *do_allocate(std::size_t bytes, std::size_t alignment) override
+    {
+        if (bytes > chunk_ || alignment > alignof(std::max_align_t))
+            return upstream_->allocate(bytes, alignment);
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (!free_)
+        {
+            ++inline_maps_;
+            lock.unlock();
+            void *slab = map_slab();
+            lock.lock();
+            add_slab(slab);
+        }
+        free_chunk *f = free_;
+        free_ = f->next;
+        --free_count_;
+        const bool low = free_count_ < headroom_ / 2;
+        lock.unlock();
+        if (low)
+            wake_.notify_one();
+        return f;
+    }
+
+    void do_deallocate(void *p, std::size_t bytes, std::size_t alignment) override
+    {
+        if (bytes > chunk_ || alignment > alignof(std::max_align_t))
+            return upstream_->deallocate(p, bytes, alignment);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        free_ = ::new (p) free_chunk{free_};
+        ++free_count_;
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+    {
+        return this == &other;
+    }
+
+    const std::size_t chunk_;
+    const std::size_t slab_chunks_;
+    std::pmr::memory_resource *upstream_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;
+    free_chunk *free_ = nullptr;
+    std::size_t free_count_ = 0;
+    std::size_t inline_maps_ = 0;
+    std::size_t refill_failures_ = 0;
+    std::size_t headroom_ = 0;
+    bool stop_ = false;
+    std::vector<void *> slabs_;
+    std::thread refill_;
+};
+
+template <typename Func>
+auto benchmark(Func test_func, int iterations)
+{
+    const auto start = std::chrono::system_clock::now();
+    while (iterations-- > 0)
+    {
+        test_func();
+    }
+    const auto stop = std::chrono::system_clock::now();
+    const auto secs = std::chrono::duration<double>(stop - start);
+    return secs.count();
+}
+
+// traffic: bursts of allocations that all stay alive, a pause after each burst
+constexpr std::size_t object_size{256};
+constexpr std::size_t burst{4'096};
+constexpr int bursts{250};
+constexpr std::size_t total{burst * bursts};
+
+// alloc() is timed together with the first write into the new object
+template <class Alloc>
+std::vector<std::int64_t> run_bursts(Alloc alloc, std::vector<void *> &live)
+{
+    std::vector<std::int64_t> latency;
+    latency.reserve(total);
+    live.reserve(total);
+    for (int b = 0; b != bursts; ++b)
+    {
+        for (std::size_t i = 0; i != burst; ++i)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            void *p = alloc();
+            std::memset(p, static_cast<int>(i), 64);
+            const auto stop = std::chrono::steady_clock::now();
+            latency.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count());
+            live.push_back(p);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return latency;
+}
+
+void print(const char *name, std::vector<std::int64_t> &lat, double warmup_secs)
+{
+    std::sort(lat.begin(), lat.end());
+    auto pct = [&](double p)
+    { return lat[std::min(lat.size() - 1, static_cast<std::size_t>(p * lat.size()))]; };
+    std::cout << "  " << name << " ns p50 = " << pct(0.5) << ", p99 = " << pct(0.99) << ", p99.9 = " << pct(0.999)
+              << ", p99.99 = " << pct(0.9999) << ", max = " << lat.back() << "; warm-up " << warmup_secs << " sec\n";
+}
+
+void test_my_pool_alloc()
+{
+    std::vector<void *> live;
+    {
+        Pool pool(object_size);
+        my_pool_alloc<std::byte> alloc(pool);
+        auto lat = run_bursts([&]
+                              { return static_cast<void *>(alloc.allocate(1)); },
+                              live);
+        print("t1 (my_pool_alloc, cold):                 ", lat, 0);
+        live.clear();
+    }
+    {
+        Pool pool(object_size);
+        my_pool_alloc<std::byte> alloc(pool);
+        const double warmup = benchmark([&]
+                                        { alloc.reserve(total); },
+                                        1);
+        auto lat = run_bursts([&]
+                              { return static_cast<void *>(alloc.allocate(1)); },
+                              live);
+        print("t2 (my_pool_alloc, reserve):              ", lat, warmup);
+        live.clear();
+    }
+}
+
+void test_headroom_resource()
+{
+    std::vector<void *> live;
+    auto alloc_from = [](headroom_resource &r)
+    {
+        return [&r]
+        { return r.allocate(object_size); };
+    };
+    {
+        headroom_resource r(object_size);
+        auto lat = run_bursts(alloc_from(r), live);
+        print("t3 (headroom_resource, cold):             ", lat, 0);
+        std::cout << "    slabs mapped by the allocating thread: " << r.inline_maps() << '\n';
+        live.clear();
+    }
+    {
+        headroom_resource r(object_size);
+        const double warmup = benchmark([&]
+                                        { r.reserve(total); },
+                                        1);
+        auto lat = run_bursts(alloc_from(r), live);
+        print("t4 (headroom_resource, reserve):          ", lat, warmup);
+        std::cout << "    slabs mapped by the allocating thread: " << r.inline_maps() << '\n';
+        live.clear();
+    }
+    {
+        headroom_resource r(object_size);
+        const double warmup = benchmark([&]
+                                        { r.reserve(2 * burst); r.keep_headroom(2 * burst); },
+                                        1);
+        auto lat = run_bursts(alloc_from(r), live);
+        print("t5 (headroom_resource, background refill):", lat, warmup);
+        std::cout << "    slabs mapped by the allocating thread: " << r.inline_maps() << '\n';
+        live.clear();
+    }
+}
+
+int main()
+{
+    std::cout << total << " allocations of " << object_size << " bytes in " << bursts << " bursts, kept alive:\n";
+    test_my_pool_alloc();
+    test_headroom_resource();
+
+    return 0;
+}
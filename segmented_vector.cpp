@@ -0,0 +1,162 @@
+#include "my_pool_alloc.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <vector>
+
+template <typename Func>
+auto benchmark(Func test_func, int iterations)
+{
+    const auto start = std::chrono::system_clock::now();
+    while (iterations-- > 0)
+    {
+        test_func();
+    }
+    const auto stop = std::chrono::system_clock::now();
+    const auto secs = std::chrono::duration<double>(stop - start);
+    return secs.count();
+}
+
+// pushes are timed in groups, a single push is shorter than a clock read
+constexpr std::size_t group{64};
+
+struct record
+{
+    std::uint64_t id;
+    std::uint64_t fields[7];
+};
+
+record make(std::size_t i, record *)
+{
+    return {i, {i, i + 1, i + 2, i + 3, i + 4, i + 5, i + 6}};
+}
+
+int make(std::size_t i, int *)
+{
+    return static_cast<int>(i);
+}
+
+std::uint64_t key(const record &r) { return r.id; }
+std::uint64_t key(int v) { return static_cast<std::uint64_t>(v); }
+
+struct result
+{
+    double push_secs = 0;
+    std::vector<std::int64_t> group_ns;
+    double scan_secs = 0;
+    double random_secs = 0;
+    std::uint64_t checksum = 0;
+};
+
+template <class Vector>
+result run(Vector &v, std::size_t n, const std::vector<std::size_t> &probes)
+{
+    using T = std::decay_t<decltype(*v.begin())>;
+    result r;
+    r.group_ns.reserve(n / group);
+
+    const auto start = std::chrono::steady_clock::now();
+    auto last = start;
+    for (std::size_t i{}; i != n; ++i)
+    {
+        v.push_back(make(i, static_cast<T *>(nullptr)));
+        if ((i + 1) % group == 0)
+        {
+            const auto now = std::chrono::steady_clock::now();
+            r.group_ns.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(now - last).count());
+            last = now;
+        }
+    }
+    r.push_secs = std::chrono::duration<double>(last - start).count();
+
+    r.scan_secs = benchmark([&]
+                            {
+                                for (const auto &x : v)
+                                {
+                                    r.checksum += key(x);
+                                } },
+                            5);
+    r.random_secs = benchmark([&]
+                              {
+                                  for (std::size_t p : probes)
+                                  {
+                                      r.checksum += key(v[p]);
+                                  } },
+                              1);
+    return r;
+}
+
+void print(const char *name, std::size_t n, result &r)
+{
+    auto &lat = r.group_ns;
+    std::sort(lat.begin(), lat.end());
+    auto pct = [&](double p)
+    { return lat[std::min(lat.size() - 1, static_cast<std::size_t>(p * lat.size()))] / static_cast<double>(group); };
+
+    std::cout << std::fixed << "  " << name << r.push_secs << " sec; " << n / r.push_secs / 1e6
+              << " M push/s; ns/push per group of " << group << " p50 = " << pct(0.5) << ", p99 = " << pct(0.99)
+              << ", p99.9 = " << pct(0.999) << ", max = " << lat.back() / static_cast<double>(group)
+              << "; scan x5 " << r.scan_secs << " sec, random reads " << r.random_secs
+              << " sec; checksum: " << r.checksum << '\n';
+}
+
+template <class T, int segment>
+void test_push(std::size_t n, const char *label)
+{
+    std::mt19937_64 rng(42);
+    std::uniform_int_distribution<std::size_t> dist(0, n - 1);
+    std::vector<std::size_t> probes(n);
+    for (auto &p : probes)
+    {
+        p = dist(rng);
+    }
+
+    std::cout << n << ' ' << label << ":\n";
+    {
+        std::vector<T> v;
+        auto r = run(v, n, probes);
+        print("t1 (std::vector):            ", n, r);
+    }
+    {
+        my_vector<T> v;
+        auto r = run(v, n, probes);
+        print("t2 (my_vector):              ", n, r);
+    }
+    {
+        segmented_vector<T, segment> v;
+        auto r = run(v, n, probes);
+        print("t3 (segmented_vector):       ", n, r);
+    }
+    {
+        // the pool is warm: segments of the previous vector are reused
+        Pool pool(sizeof(T) * segment, 32, 32);
+        {
+            segmented_vector<T, segment> v(pool);
+            run(v, n, probes);
+        }
+        segmented_vector<T, segment> v(pool);
+        auto r = run(v, n, probes);
+        print("t4 (segmented, warm pool):   ", n, r);
+    }
+    {
+        // a cold owned pool grown up front, the pushes only fill segments
+        segmented_vector<T, segment> v;
+        const double secs = benchmark([&]
+                                      { v.reserve(n); },
+                                      1);
+        auto r = run(v, n, probes);
+        print("t5 (segmented, reserve):     ", n, r);
+        std::cout << "      reserve took " << secs << " sec\n";
+    }
+}
+
+int main()
+{
+    test_push<int, 1024>(10'000'000, "ints, 4 KiB segments");
+    test_push<record, 64>(2'000'000, "64-byte records, 4 KiB segments");
+
+    return 0;
+}
@@ -0,0 +1,297 @@
+#include "my_pool_alloc.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Concurrent map split by key hash into Shards ordered maps. Every shard has
+// its own reader-writer lock and its own Pool, so threads working on
+// different shards share neither a lock nor an allocator; readers of one
+// shard share its lock. Shards sit on separate cache lines.
+// Values are copied out under the lock, references never escape.
+template <class K, class V, std::size_t Shards = 16, class Hash = std::hash<K>, class Compare = std::less<K>>
+class sharded_map
+{
+    static_assert(Shards && (Shards & (Shards - 1)) == 0, "shard count is a power of two");
+
+public:
+    using value_type = std::pair<const K, V>;
+    using allocator_type = my_pool_alloc<value_type>;
+    using shard_map = std::map<K, V, Compare, allocator_type>;
+
+    // chunk for one rb-tree node: color, three links and the pair
+    static constexpr std::size_t node_size = 4 * sizeof(void *) + sizeof(value_type);
+
+    sharded_map() = default;
+    sharded_map(const sharded_map &) = delete;
+    sharded_map &operator=(const sharded_map &) = delete;
+
+    bool find(const K &key, V &out) const
+    {
+        const shard &s = shard_of(key);
+        std::shared_lock<std::shared_mutex> lock(s.mutex);
+        auto it = s.map.find(key);
+        if (it == s.map.end())
+            return false;
+        out = it->second;
+        return true;
+    }
+
+    bool contains(const K &key) const
+    {
+        const shard &s = shard_of(key);
+        std::shared_lock<std::shared_mutex> lock(s.mutex);
+        return s.map.count(key) != 0;
+    }
+
+    // true when the key was new
+    template <class M>
+    bool insert_or_assign(const K &key, M &&value)
+    {
+        shard &s = shard_of(key);
+        std::unique_lock<std::shared_mutex> lock(s.mutex);
+        return s.map.insert_or_assign(key, std::forward<M>(value)).second;
+    }
+
+    bool erase(const K &key)
+    {
+        shard &s = shard_of(key);
+        std::unique_lock<std::shared_mutex> lock(s.mutex);
+        return s.map.erase(key) != 0;
+    }
+
+    // f(value) under the shard's write lock, with a default-constructed value for a new key
+    template <class F>
+    void update(const K &key, F f)
+    {
+        shard &s = shard_of(key);
+        std::unique_lock<std::shared_mutex> lock(s.mutex);
+        f(s.map[key]);
+    }
+
+    // shard by shard, so not a snapshot while writers run
+    std::size_t size() const
+    {
+        std::size_t n = 0;
+        for (const shard &s : shards_)
+        {
+            std::shared_lock<std::shared_mutex> lock(s.mutex);
+            n += s.map.size();
+        }
+        return n;
+    }
+
+    // f(key, value) for every entry, shard by shard, each in key order
+    template <class F>
+    void for_each(F f) const
+    {
+        for (const shard &s : shards_)
+        {
+            std::shared_lock<std::shared_mutex> lock(s.mutex);
+            for (const auto &kv : s.map)
+            {
+                f(kv.first, kv.second);
+            }
+        }
+    }
+
+private:
+    struct alignas(64) shard
+    {
+        // blocks of 32 nodes as in my_pool_alloc, a short tail of free chunks keeps ordered_free cheap
+        shard() : pool(node_size, 32, 32), map(allocator_type(pool)) {}
+
+        mutable std::shared_mutex mutex;
+        Pool pool;
+        shard_map map;
+    };
+
+    static std::size_t index(const K &key)
+    {
+        const std::uint64_t h = static_cast<std::uint64_t>(Hash()(key)) * 0x9E3779B97F4A7C15ull;
+        return Shards == 1 ? 0 : static_cast<std::size_t>(h >> (64 - shard_bits()));
+    }
+
+    static constexpr int shard_bits()
+    {
+        int bits = 0;
+        while ((std::size_t{1} << bits) < Shards)
+        {
+            ++bits;
+        }
+        return bits;
+    }
+
+    shard &shard_of(const K &key) { return shards_[index(key)]; }
+    const shard &shard_of(const K &key) const { return shards_[index(key)]; }
+
+    shard shards_[Shards];
+};
+
+// what the services do today: m2 behind one mutex
+template <class K, class V>
+class locked_map
+{
+public:
+    using value_type = std::pair<const K, V>;
+    using allocator_type = my_pool_alloc<value_type>;
+
+    locked_map() : pool_(4 * sizeof(void *) + sizeof(value_type), 32, 32), map_(allocator_type(pool_)) {}
+
+    bool find(const K &key, V &out) const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = map_.find(key);
+        if (it == map_.end())
+            return false;
+        out = it->second;
+        return true;
+    }
+
+    template <class M>
+    bool insert_or_assign(const K &key, M &&value)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return map_.insert_or_assign(key, std::forward<M>(value)).second;
+    }
+
+    bool erase(const K &key)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return map_.erase(key) != 0;
+    }
+
+    std::size_t size() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return map_.size();
+    }
+
+private:
+    mutable std::mutex mutex_;
+    Pool pool_;
+    std::map<K, V, std::less<K>, allocator_type> map_;
+};
+
+constexpr int key_space{1 << 16};
+constexpr std::size_t total_ops{1'000'000};
+
+struct xorshift
+{
+    std::uint64_t s;
+    std::uint64_t operator()()
+    {
+        s ^= s << 13;
+        s ^= s >> 7;
+        s ^= s << 17;
+        return s;
+    }
+};
+
+// total_ops spread over the threads; a write is an insert_or_assign or an
+// erase with equal odds, so about half of the key space stays occupied
+template <class Map>
+double run_mix(Map &m, unsigned threads, unsigned read_percent, std::uint64_t &checksum)
+{
+    std::atomic<bool> go{false};
+    std::atomic<unsigned> ready{0};
+    std::atomic<std::uint64_t> found{0};
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t != threads; ++t)
+    {
+        workers.emplace_back([&, t]
+                             {
+                                 xorshift rng{0x9E3779B97F4A7C15ull * (t + 1)};
+                                 const std::size_t ops = total_ops / threads;
+                                 std::uint64_t hits = 0;
+                                 ready.fetch_add(1);
+                                 while (!go.load(std::memory_order_acquire))
+                                 {
+                                     std::this_thread::yield();
+                                 }
+                                 for (std::size_t i = 0; i != ops; ++i)
+                                 {
+                                     const std::uint64_t r = rng();
+                                     const int key = static_cast<int>(r % key_space);
+                                     const unsigned dice = static_cast<unsigned>((r >> 32) % 100);
+                                     int value = 0;
+                                     if (dice < read_percent)
+                                         hits += m.find(key, value) ? static_cast<unsigned>(value) : 0;
+                                     else if (dice & 1)
+                                         m.insert_or_assign(key, static_cast<int>(i));
+                                     else
+                                         m.erase(key);
+                                 }
+                                 found.fetch_add(hits); });
+    }
+    while (ready.load() != threads)
+    {
+        std::this_thread::yield();
+    }
+    const auto start = std::chrono::steady_clock::now();
+    go.store(true, std::memory_order_release);
+    for (auto &w : workers)
+    {
+        w.join();
+    }
+    const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    checksum += found.load() + m.size();
+    return secs;
+}
+
+template <class Map>
+void prefill(Map &m)
+{
+    for (int k = 0; k < key_space; k += 2)
+    {
+        m.insert_or_assign(k, k);
+    }
+}
+
+void test_mix(unsigned read_percent, unsigned max_threads)
+{
+    std::cout << std::fixed << read_percent << "/" << 100 - read_percent << " read/write, "
+              << total_ops << " ops over " << key_space << " keys:\n";
+    std::uint64_t checksum = 0;
+    for (unsigned threads = 1;; threads = std::min(threads * 2, max_threads))
+    {
+        // fresh maps per row, pools never carry the previous row's free lists
+        locked_map<int, int> one;
+        sharded_map<int, int, 16> sixteen;
+        sharded_map<int, int, 64> sixty_four;
+        prefill(one);
+        prefill(sixteen);
+        prefill(sixty_four);
+
+        const double t1 = run_mix(one, threads, read_percent, checksum);
+        const double t2 = run_mix(sixteen, threads, read_percent, checksum);
+        const double t3 = run_mix(sixty_four, threads, read_percent, checksum);
+        std::cout << "  " << threads << " thread(s): t1 (std::map + my_pool_alloc, one mutex) " << total_ops / t1 / 1e6
+                  << " M ops/s; t2 (16 shards) " << total_ops / t2 / 1e6
+                  << " M ops/s; t3 (64 shards) " << total_ops / t3 / 1e6 << " M ops/s\n";
+        if (threads == max_threads)
+            break;
+    }
+    std::cout << "  checksum: " << checksum << '\n';
+}
+
+// usage: 21_sharded_map [max threads]
+int main(int argc, char *argv[])
+{
+    const unsigned max_threads = argc > 1 ? static_cast<unsigned>(std::max(1, std::atoi(argv[1]))) : 64;
+
+    test_mix(95, max_threads);
+    test_mix(50, max_threads);
+
+    return 0;
+}
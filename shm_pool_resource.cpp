@@ -0,0 +1,473 @@
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory_resource>
+#include <new>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// memory_resource that carves blocks out of a POSIX shared memory segment.
+// Free lists are stored inside the segment as offsets and guarded by a
+// process-shared spinlock, so several processes may allocate and free.
+// Containers keep raw pointers, therefore every process maps the segment
+// at the address chosen by the creator.
+class shm_pool_resource : public std::pmr::memory_resource
+{
+public:
+    static constexpr std::size_t min_block = 16;
+    static constexpr std::size_t small_limit = 256;
+    static constexpr std::size_t page = 4096;
+    // 16 byte steps up to small_limit, then powers of two up to 2^40 bytes
+    static constexpr std::size_t num_classes = small_limit / min_block + 32;
+
+    // creates a new segment (replaces an existing one with the same name)
+    static shm_pool_resource create(const std::string &name, std::size_t size)
+    {
+        ::shm_unlink(name.c_str());
+        int fd = ::shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd < 0)
+            throw std::runtime_error("shm_open failed for " + name);
+        if (::ftruncate(fd, static_cast<off_t>(size)) != 0)
+        {
+            ::close(fd);
+            throw std::runtime_error("ftruncate failed for " + name);
+        }
+        void *addr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (addr == MAP_FAILED)
+            throw std::bad_alloc();
+
+        auto *hdr = new (addr) header{};
+        hdr->base = reinterpret_cast<std::uintptr_t>(addr);
+        hdr->size = size;
+        hdr->top = align_up(sizeof(header), min_block);
+        hdr->magic.store(magic_value, std::memory_order_release);
+        return shm_pool_resource(name, hdr, true);
+    }
+
+    // maps an existing segment at the address used by its creator
+    static shm_pool_resource attach(const std::string &name, bool read_only = true)
+    {
+        int fd = ::shm_open(name.c_str(), read_only ? O_RDONLY : O_RDWR, 0);
+        if (fd < 0)
+            throw std::runtime_error("shm_open failed for " + name);
+
+        header probe;
+        if (::pread(fd, &probe, sizeof(probe), 0) != static_cast<ssize_t>(sizeof(probe)) ||
+            probe.magic.load(std::memory_order_acquire) != magic_value)
+        {
+            ::close(fd);
+            throw std::runtime_error("segment " + name + " is not initialized");
+        }
+
+        int prot = read_only ? PROT_READ : PROT_READ | PROT_WRITE;
+        void *want = reinterpret_cast<void *>(probe.base);
+        void *addr = ::mmap(want, probe.size, prot, MAP_SHARED | fixed_noreplace, fd, 0);
+        ::close(fd);
+        if (addr == MAP_FAILED)
+            throw std::runtime_error("cannot map " + name + " at the creator's address");
+        if (addr != want)
+        {
+            ::munmap(addr, probe.size);
+            throw std::runtime_error("cannot map " + name + " at the creator's address");
+        }
+        return shm_pool_resource(name, static_cast<header *>(addr), false);
+    }
+
+    shm_pool_resource(shm_pool_resource &&other) noexcept
+        : name_(std::move(other.name_)), hdr_(other.hdr_), owner_(other.owner_)
+    {
+        other.hdr_ = nullptr;
+        other.owner_ = false;
+    }
+
+    shm_pool_resource(const shm_pool_resource &) = delete;
+    shm_pool_resource &operator=(const shm_pool_resource &) = delete;
+
+    ~shm_pool_resource() override
+    {
+        if (!hdr_)
+            return;
+        ::munmap(hdr_, hdr_->size);
+        if (owner_)
+            ::shm_unlink(name_.c_str());
+    }
+
+    // constructs the object every attached process looks up by find_root
+    template <typename T, typename... Args>
+    T *construct_root(Args &&...args)
+    {
+        void *p = allocate(sizeof(T), alignof(T));
+        T *obj = new (p) T(std::forward<Args>(args)...);
+        hdr_->root.store(offset_of(obj), std::memory_order_release);
+        return obj;
+    }
+
+    template <typename T>
+    const T *find_root() const
+    {
+        std::size_t off = hdr_->root.load(std::memory_order_acquire);
+        return off ? static_cast<const T *>(at(off)) : nullptr;
+    }
+
+    std::size_t used() const { return hdr_->top; }
+    std::size_t capacity() const { return hdr_->size; }
+
+private:
+    static constexpr std::uint64_t magic_value = 0x53484d504f4f4c31ull; // "SHMPOOL1"
+#ifdef MAP_FIXED_NOREPLACE
+    static constexpr int fixed_noreplace = MAP_FIXED_NOREPLACE;
+#else
+    static constexpr int fixed_noreplace = 0; // plain hint, checked after mmap
+#endif
+
+    struct header
+    {
+        std::atomic<std::uint64_t> magic{0};
+        std::uintptr_t base = 0;
+        std::size_t size = 0;
+        std::size_t top = 0;
+        std::atomic<std::size_t> root{0};
+        std::atomic<bool> lock{false};
+        std::size_t free_head[num_classes] = {};
+    };
+
+    static_assert(std::atomic<bool>::is_always_lock_free, "process-shared lock must be address free");
+    static_assert(std::atomic<std::size_t>::is_always_lock_free, "process-shared root must be address free");
+
+    struct spin_guard
+    {
+        explicit spin_guard(std::atomic<bool> &l) : lock(l)
+        {
+            while (lock.exchange(true, std::memory_order_acquire))
+            {
+                while (lock.load(std::memory_order_relaxed))
+                    ;
+            }
+        }
+        ~spin_guard() { lock.store(false, std::memory_order_release); }
+        std::atomic<bool> &lock;
+    };
+
+    shm_pool_resource(std::string name, header *hdr, bool owner)
+        : name_(std::move(name)), hdr_(hdr), owner_(owner) {}
+
+    static std::size_t align_up(std::size_t n, std::size_t align)
+    {
+        return (n + align - 1) & ~(align - 1);
+    }
+
+    // every block is carved aligned to the lowest set bit of its size (capped at
+    // a page), so rounding the request up to a multiple of align is enough;
+    // a request that cannot fit the segment throws before shared state is touched
+    std::size_t size_class(std::size_t bytes, std::size_t align, std::size_t &block) const
+    {
+        if (align > page || bytes > hdr_->size)
+            throw std::bad_alloc();
+        bytes = align_up(bytes ? bytes : 1, align < min_block ? min_block : align);
+        if (bytes <= small_limit)
+        {
+            block = bytes;
+            return bytes / min_block - 1;
+        }
+        std::size_t cls = small_limit / min_block;
+        block = small_limit * 2;
+        while (block < bytes)
+        {
+            block <<= 1;
+            if (++cls == num_classes)
+                throw std::bad_alloc();
+        }
+        return cls;
+    }
+
+    void *at(std::size_t off) const { return reinterpret_cast<char *>(hdr_) + off; }
+    std::size_t offset_of(const void *p) const
+    {
+        return static_cast<std::size_t>(static_cast<const char *>(p) - reinterpret_cast<const char *>(hdr_));
+    }
+
+    void *do_allocate(std::size_t bytes, std::size_t align) override
+    {
+        std::size_t block = 0;
+        std::size_t cls = size_class(bytes, align, block);
+
+        spin_guard guard(hdr_->lock);
+        if (std::size_t off = hdr_->free_head[cls])
+        {
+            hdr_->free_head[cls] = *static_cast<std::size_t *>(at(off));
+            return at(off);
+        }
+
+        std::size_t low_bit = block & (~block + 1);
+        std::size_t off = align_up(hdr_->top, low_bit < page ? low_bit : page);
+        if (off + block > hdr_->size)
+            throw std::bad_alloc();
+        hdr_->top = off + block;
+        return at(off);
+    }
+
+    void do_deallocate(void *p, std::size_t bytes, std::size_t align) override
+    {
+        std::size_t block = 0;
+        std::size_t cls = size_class(bytes, align, block);
+        std::size_t off = offset_of(p);
+
+        spin_guard guard(hdr_->lock);
+        *static_cast<std::size_t *>(p) = hdr_->free_head[cls];
+        hdr_->free_head[cls] = off;
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+    {
+        auto *o = dynamic_cast<const shm_pool_resource *>(&other);
+        return o && o->hdr_ == hdr_;
+    }
+
+    std::string name_;
+    header *hdr_;
+    bool owner_;
+};
+
+// the same segment behind the allocator interface of my_pool_alloc
+template <typename T>
+struct shm_pool_alloc
+{
+    using value_type = T;
+
+    template <typename U>
+    struct rebind
+    {
+        using other = shm_pool_alloc<U>;
+    };
+
+    shm_pool_alloc(shm_pool_resource &res) noexcept : res_(&res) {}
+
+    template <typename U>
+    shm_pool_alloc(const shm_pool_alloc<U> &other) noexcept : res_(other.resource()) {}
+
+    T *allocate(const std::size_t n)
+    {
+        return static_cast<T *>(res_->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T *ptr, const std::size_t n)
+    {
+        if (ptr && n)
+            res_->deallocate(ptr, n * sizeof(T), alignof(T));
+    }
+
+    shm_pool_resource *resource() const noexcept { return res_; }
+
+private:
+    shm_pool_resource *res_;
+};
+
+template <class T, class U> bool operator==(const shm_pool_alloc<T> &a, const shm_pool_alloc<U> &b) { return a.resource() == b.resource(); }
+template <class T, class U> bool operator!=(const shm_pool_alloc<T> &a, const shm_pool_alloc<U> &b) { return a.resource() != b.resource(); }
+
+using lookup_map = std::pmr::map<std::pmr::string, int, std::less<>>;
+
+constexpr int total_keys{200'000};
+constexpr int total_lookups{200'000};
+constexpr int workers{4};
+const char *segment_name = "/otus_shm_pool_resource";
+
+std::string make_key(int i)
+{
+    return "lookup-key-" + std::to_string(i * 7919) + "-value";
+}
+
+void fill(lookup_map &m)
+{
+    for (int i{}; i != total_keys; ++i)
+    {
+        m.emplace(make_key(i), i);
+    }
+}
+
+// proportional set size: shared pages are split between the processes mapping them
+long pss_kb()
+{
+    FILE *f = std::fopen("/proc/self/smaps_rollup", "r");
+    if (!f)
+        return -1;
+    char line[256];
+    long pss = -1;
+    while (std::fgets(line, sizeof(line), f))
+    {
+        if (std::sscanf(line, "Pss: %ld kB", &pss) == 1)
+            break;
+    }
+    std::fclose(f);
+    return pss;
+}
+
+struct worker_report
+{
+    double ns_per_lookup;
+    long found;
+};
+
+worker_report run_lookups(const lookup_map &m)
+{
+    std::vector<std::string> probes;
+    probes.reserve(1024);
+    for (int i{}; i != 1024; ++i)
+    {
+        probes.push_back(make_key((i * 193) % (total_keys + 100)));
+    }
+
+    long found = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (int i{}; i != total_lookups; ++i)
+    {
+        found += m.find(std::string_view(probes[i & 1023])) != m.end();
+    }
+    const auto stop = std::chrono::steady_clock::now();
+    const double ns = std::chrono::duration<double, std::nano>(stop - start).count();
+    return {ns / total_lookups, found};
+}
+
+// pipe helpers for the fork barrier, a short read means the peer is gone
+template <typename T>
+void send(int fd, const T &value)
+{
+    if (::write(fd, &value, sizeof(T)) != static_cast<ssize_t>(sizeof(T)))
+        throw std::runtime_error("pipe write failed");
+}
+
+template <typename T>
+T receive(int fd)
+{
+    T value{};
+    if (::read(fd, &value, sizeof(T)) != static_cast<ssize_t>(sizeof(T)))
+        throw std::runtime_error("pipe read failed");
+    return value;
+}
+
+// Workers are forked first so that the segment is mapped by attach, not inherited.
+// PSS is sampled only when every process holds its map, otherwise the shared
+// pages would be charged to whoever happened to be mapping them alone.
+long run_workers(bool shared)
+{
+    int go[2];
+    int measure[2];
+    int reports[2];
+    if (::pipe(go) != 0 || ::pipe(measure) != 0 || ::pipe(reports) != 0)
+        throw std::runtime_error("pipe failed");
+
+    for (int w{}; w != workers; ++w)
+    {
+        if (::fork() == 0)
+        {
+            ::close(go[1]);
+            ::close(measure[1]);
+            ::close(reports[0]);
+            receive<char>(go[0]);
+
+            std::optional<shm_pool_resource> res;
+            std::optional<lookup_map> own;
+            const lookup_map *m = nullptr;
+            if (shared)
+            {
+                res.emplace(shm_pool_resource::attach(segment_name));
+                m = res->find_root<lookup_map>();
+            }
+            else
+            {
+                fill(own.emplace());
+                m = &*own;
+            }
+            send(reports[1], run_lookups(*m));
+            receive<char>(measure[0]);
+            send(reports[1], pss_kb());
+            ::_exit(0);
+        }
+    }
+    ::close(go[0]);
+    ::close(measure[0]);
+    ::close(reports[1]);
+
+    std::optional<shm_pool_resource> res;
+    std::size_t segment_used = 0;
+    if (shared)
+    {
+        // the map itself is never destroyed: it lives and dies with the segment
+        res.emplace(shm_pool_resource::create(segment_name, 256 << 20));
+        fill(*res->construct_root<lookup_map>(&*res));
+        segment_used = res->used();
+    }
+
+    for (int w{}; w != workers; ++w)
+    {
+        send(go[1], char{});
+    }
+
+    double total_ns = 0;
+    for (int w{}; w != workers; ++w)
+    {
+        total_ns += receive<worker_report>(reports[0]).ns_per_lookup;
+    }
+
+    long total_pss = shared ? pss_kb() : 0;
+    for (int w{}; w != workers; ++w)
+    {
+        send(measure[1], char{});
+    }
+    for (int w{}; w != workers; ++w)
+    {
+        total_pss += receive<long>(reports[0]);
+    }
+    for (int w{}; w != workers; ++w)
+    {
+        ::wait(nullptr);
+    }
+    ::close(go[1]);
+    ::close(measure[1]);
+    ::close(reports[0]);
+
+    std::cout << (shared ? "shared segment: " : "private maps:   ")
+              << "total PSS = " << total_pss << " kB, "
+              << "lookup = " << total_ns / workers << " ns";
+    if (shared)
+        std::cout << ", segment used = " << (segment_used >> 10) << " kB";
+    std::cout << std::endl;
+    return total_pss;
+}
+
+int main()
+{
+    {
+        // allocate, free and reuse inside one process
+        auto res = shm_pool_resource::create(segment_name, 1 << 20);
+        std::pmr::vector<int> v(&res);
+        for (int i = 0; i < 1000; ++i)
+        {
+            v.push_back(i);
+        }
+        std::vector<long, shm_pool_alloc<long>> lv(100, 1, shm_pool_alloc<long>(res));
+        std::cout << "segment used after warm-up: " << res.used() << " bytes" << std::endl;
+    }
+
+    const long priv = run_workers(false);
+    const long shared = run_workers(true);
+    std::cout << std::fixed << "PSS saved: " << priv - shared << " kB ("
+              << 100.0 * (priv - shared) / priv << "%)" << std::endl;
+
+    return 0;
+}
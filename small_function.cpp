@@ -0,0 +1,331 @@
+#include "my_pool_alloc.h"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+template <class Signature, std::size_t InlineSize = 32, class Alloc = std::allocator<std::byte>>
+class small_function;
+
+// Move-only std::function replacement.
+// Callables of up to InlineSize bytes live inside the object, bigger ones are
+// allocated with Alloc rebound to their own type, so a my_pool_alloc pool or a
+// pmr resource can hold them. A call is one indirect call through a plain
+// function pointer; a second pointer moves and destroys, nothing is virtual.
+// The allocator moves along with the callable; on move assignment it follows
+// propagate_on_container_move_assignment, unequal allocators get a copy of the
+// callable in their own memory.
+template <class R, class... Args, std::size_t InlineSize, class Alloc>
+class small_function<R(Args...), InlineSize, Alloc> : private Alloc
+{
+    static_assert(InlineSize >= sizeof(void *), "the inline buffer also holds the heap pointer");
+
+    using alloc_traits = std::allocator_traits<Alloc>;
+
+    union storage
+    {
+        alignas(std::max_align_t) unsigned char buf[InlineSize];
+        void *heap;
+    };
+
+    enum class op
+    {
+        move,
+        destroy,
+    };
+
+    using invoke_fn = R (*)(storage &, Args &&...);
+    using manage_fn = void (*)(op, storage &self, storage *other, Alloc &self_alloc, Alloc *other_alloc);
+
+    template <class F>
+    static constexpr bool fits_inline = sizeof(F) <= InlineSize &&
+                                        alignof(F) <= alignof(std::max_align_t) &&
+                                        std::is_nothrow_move_constructible_v<F>;
+
+    template <class F>
+    struct inline_ops
+    {
+        static F &get(storage &s) { return *std::launder(reinterpret_cast<F *>(s.buf)); }
+
+        static R invoke(storage &s, Args &&...args)
+        {
+            return std::invoke(get(s), std::forward<Args>(args)...);
+        }
+
+        // move: self is constructed from other, the other one is left empty
+        static void manage(op o, storage &self, storage *other, Alloc &, Alloc *)
+        {
+            if (o == op::move)
+            {
+                ::new (self.buf) F(std::move(get(*other)));
+                get(*other).~F();
+            }
+            else
+            {
+                get(self).~F();
+            }
+        }
+    };
+
+    template <class F>
+    struct heap_ops
+    {
+        using traits = typename alloc_traits::template rebind_traits<F>;
+        using alloc_type = typename alloc_traits::template rebind_alloc<F>;
+
+        static F &get(storage &s) { return *static_cast<F *>(s.heap); }
+
+        static R invoke(storage &s, Args &&...args)
+        {
+            return std::invoke(get(s), std::forward<Args>(args)...);
+        }
+
+        template <class G>
+        static void create(storage &s, Alloc &alloc, G &&g)
+        {
+            alloc_type a(alloc);
+            F *p = traits::allocate(a, 1);
+            try
+            {
+                traits::construct(a, p, std::forward<G>(g));
+            }
+            catch (...)
+            {
+                traits::deallocate(a, p, 1);
+                throw;
+            }
+            s.heap = p;
+        }
+
+        static void destroy(storage &s, Alloc &alloc)
+        {
+            alloc_type a(alloc);
+            traits::destroy(a, static_cast<F *>(s.heap));
+            traits::deallocate(a, static_cast<F *>(s.heap), 1);
+        }
+
+        static void manage(op o, storage &self, storage *other, Alloc &self_alloc, Alloc *other_alloc)
+        {
+            if (o == op::destroy)
+                return destroy(self, self_alloc);
+            // the target changes hands only if self_alloc can free it
+            if (self_alloc == *other_alloc)
+            {
+                self.heap = other->heap;
+                return;
+            }
+            create(self, self_alloc, std::move(get(*other)));
+            destroy(*other, *other_alloc);
+        }
+    };
+
+public:
+    using allocator_type = Alloc;
+    using result_type = R;
+
+    small_function() noexcept(noexcept(Alloc())) = default;
+    explicit small_function(const Alloc &alloc) noexcept : Alloc(alloc) {}
+    small_function(std::nullptr_t) noexcept : small_function() {}
+
+    template <class F, class = std::enable_if_t<!std::is_same_v<std::decay_t<F>, small_function> &&
+                                                std::is_invocable_r_v<R, std::decay_t<F> &, Args...>>>
+    small_function(F &&f) : small_function(std::allocator_arg, Alloc(), std::forward<F>(f)) {}
+
+    template <class F, class = std::enable_if_t<std::is_invocable_r_v<R, std::decay_t<F> &, Args...>>>
+    small_function(std::allocator_arg_t, const Alloc &alloc, F &&f) : Alloc(alloc)
+    {
+        using D = std::decay_t<F>;
+        if constexpr (fits_inline<D>)
+        {
+            ::new (storage_.buf) D(std::forward<F>(f));
+            invoke_ = &inline_ops<D>::invoke;
+            manage_ = &inline_ops<D>::manage;
+        }
+        else
+        {
+            heap_ops<D>::create(storage_, allocator(), std::forward<F>(f));
+            invoke_ = &heap_ops<D>::invoke;
+            manage_ = &heap_ops<D>::manage;
+        }
+    }
+
+    small_function(small_function &&other) noexcept : Alloc(other.allocator())
+    {
+        take(other);
+    }
+
+    small_function &operator=(small_function &&other) noexcept(alloc_traits::propagate_on_container_move_assignment::value)
+    {
+        if (this == &other)
+            return *this;
+        reset();
+        if constexpr (alloc_traits::propagate_on_container_move_assignment::value)
+            allocator() = std::move(other.allocator());
+        take(other);
+        return *this;
+    }
+
+    small_function(const small_function &) = delete;
+    small_function &operator=(const small_function &) = delete;
+
+    ~small_function() { reset(); }
+
+    R operator()(Args... args) const
+    {
+        if (!invoke_)
+            throw std::bad_function_call();
+        return invoke_(storage_, std::forward<Args>(args)...);
+    }
+
+    explicit operator bool() const noexcept { return invoke_ != nullptr; }
+
+    void reset() noexcept
+    {
+        if (manage_)
+            manage_(op::destroy, storage_, nullptr, allocator(), nullptr);
+        invoke_ = nullptr;
+        manage_ = nullptr;
+    }
+
+    allocator_type get_allocator() const { return allocator(); }
+
+private:
+    Alloc &allocator() { return *this; }
+    const Alloc &allocator() const { return *this; }
+
+    void take(small_function &other)
+    {
+        if (!other.manage_)
+            return;
+        other.manage_(op::move, storage_, &other.storage_, allocator(), &other.allocator());
+        invoke_ = other.invoke_;
+        manage_ = other.manage_;
+        other.invoke_ = nullptr;
+        other.manage_ = nullptr;
+    }
+
+    mutable storage storage_;
+    invoke_fn invoke_ = nullptr;
+    manage_fn manage_ = nullptr;
+};
+
+template <typename Func>
+auto benchmark(Func test_func, int iterations)
+{
+    const auto start = std::chrono::system_clock::now();
+    while (iterations-- > 0)
+    {
+        test_func();
+    }
+    const auto stop = std::chrono::system_clock::now();
+    const auto secs = std::chrono::duration<double>(stop - start);
+    return secs.count();
+}
+
+// callbacks kept alive at the same time, as a timer wheel or an event loop would
+constexpr std::size_t batch{64};
+constexpr int rounds{20'000};
+constexpr int calls_per_callback{16};
+
+template <std::size_t Bytes>
+struct capture
+{
+    std::array<std::uint64_t, Bytes / 8> v{};
+};
+
+struct timing
+{
+    double create_destroy_ns;
+    double call_ns;
+    std::uint64_t checksum;
+};
+
+// make(i) returns the callback stored as function number i of a round
+template <class Function, class Make>
+timing measure(Make make)
+{
+    std::vector<Function> callbacks;
+    callbacks.reserve(batch);
+    std::uint64_t sum = 0;
+
+    double call_secs = 0;
+    const double total = benchmark([&]
+                                   {
+                                       for (std::size_t i{}; i != batch; ++i)
+                                       {
+                                           callbacks.push_back(make(i));
+                                       }
+                                       const auto start = std::chrono::steady_clock::now();
+                                       for (int k{}; k != calls_per_callback; ++k)
+                                       {
+                                           for (auto &f : callbacks)
+                                           {
+                                               sum += f(k);
+                                           }
+                                       }
+                                       call_secs += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                                       callbacks.clear(); },
+                                   rounds);
+    const double functions = static_cast<double>(batch) * rounds;
+    return {(total - call_secs) * 1e9 / functions, call_secs * 1e9 / (functions * calls_per_callback), sum};
+}
+
+template <std::size_t Bytes>
+void test_capture()
+{
+    auto make_lambda = [](std::size_t i)
+    {
+        capture<Bytes> c;
+        c.v.front() = i;
+        c.v.back() = i * 3;
+        return [c](int k) -> std::uint64_t
+        { return c.v.front() + c.v.back() + k; };
+    };
+
+    using inline_alloc = small_function<std::uint64_t(int), 64>;
+    using pmr_alloc = small_function<std::uint64_t(int), 64, std::pmr::polymorphic_allocator<std::byte>>;
+    using pool_alloc = small_function<std::uint64_t(int), 64, my_pool_alloc<std::byte>>;
+
+    const timing t1 = measure<std::function<std::uint64_t(int)>>(make_lambda);
+    const timing t2 = measure<inline_alloc>(make_lambda);
+
+    std::pmr::unsynchronized_pool_resource resource;
+    const timing t3 = measure<pmr_alloc>([&](std::size_t i)
+                                         { return pmr_alloc(std::allocator_arg, &resource, make_lambda(i)); });
+
+    // chunks big enough for the largest capture, one chunk per callback
+    Pool pool(256 + 64);
+    const timing t4 = measure<pool_alloc>([&](std::size_t i)
+                                          { return pool_alloc(std::allocator_arg, my_pool_alloc<std::byte>(pool), make_lambda(i)); });
+
+    auto row = [](const char *name, const timing &t)
+    {
+        std::cout << "  " << name << t.create_destroy_ns << " ns create+destroy, " << t.call_ns << " ns/call; checksum = " << t.checksum << '\n';
+    };
+    std::cout << std::fixed << "capture of " << Bytes << " bytes:\n";
+    row("t1 (std::function):                     ", t1);
+    row("t2 (small_function<64>, std::allocator):", t2);
+    row("t3 (small_function<64>, pmr pool):      ", t3);
+    row("t4 (small_function<64>, my_pool_alloc): ", t4);
+}
+
+int main()
+{
+    test_capture<8>();
+    test_capture<16>();
+    test_capture<32>();
+    test_capture<64>();
+    test_capture<128>();
+    test_capture<256>();
+
+    return 0;
+}
@@ -0,0 +1,528 @@
+#include "my_pool_alloc.h"
+
+#include <boost/pool/pool_alloc.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory_resource>
+#include <random>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+// Allocator-aware string with InlineCap characters stored in the object.
+// The last inline byte keeps InlineCap - size, so a full inline string is
+// terminated by that zero, and 0xFF marks a heap string whose pointer, size
+// and capacity are kept at the front of the same buffer.
+// With an empty allocator sizeof is InlineCap + 1 rounded up to 8.
+template <std::size_t InlineCap, class Alloc = std::allocator<char>>
+class basic_small_string : private Alloc
+{
+    struct heap_rep
+    {
+        char *ptr;
+        std::uint32_t size;
+        std::uint32_t cap;
+    };
+
+    static_assert(InlineCap >= sizeof(heap_rep), "inline buffer must fit the heap representation");
+    static_assert(InlineCap < 0xFF, "inline size must fit into the tag byte");
+
+    using traits = std::allocator_traits<Alloc>;
+    static constexpr unsigned char heap_tag = 0xFF;
+
+public:
+    using allocator_type = Alloc;
+    using value_type = char;
+    using size_type = std::size_t;
+
+    basic_small_string() noexcept(noexcept(Alloc())) : Alloc() { set_inline_size(0); }
+
+    explicit basic_small_string(const Alloc &alloc) noexcept : Alloc(alloc) { set_inline_size(0); }
+
+    basic_small_string(std::string_view s, const Alloc &alloc = Alloc()) : Alloc(alloc)
+    {
+        set_inline_size(0);
+        assign(s);
+    }
+
+    basic_small_string(const char *s, const Alloc &alloc = Alloc())
+        : basic_small_string(std::string_view(s), alloc) {}
+
+    basic_small_string(const basic_small_string &other)
+        : basic_small_string(other.view(), traits::select_on_container_copy_construction(other.get_allocator())) {}
+
+    basic_small_string(const basic_small_string &other, const Alloc &alloc)
+        : basic_small_string(other.view(), alloc) {}
+
+    basic_small_string(basic_small_string &&other) noexcept : Alloc(other.get_allocator())
+    {
+        std::memcpy(raw_, other.raw_, sizeof(raw_));
+        other.set_inline_size(0);
+    }
+
+    ~basic_small_string() { release(); }
+
+    // the allocator never propagates, like pmr::string
+    basic_small_string &operator=(const basic_small_string &other)
+    {
+        if (this != &other)
+            assign(other.view());
+        return *this;
+    }
+
+    basic_small_string &operator=(basic_small_string &&other) noexcept(false)
+    {
+        if (this == &other)
+            return *this;
+        if (get_allocator() != other.get_allocator())
+            return *this = static_cast<const basic_small_string &>(other);
+        release();
+        std::memcpy(raw_, other.raw_, sizeof(raw_));
+        other.set_inline_size(0);
+        return *this;
+    }
+
+    basic_small_string &operator=(std::string_view s)
+    {
+        assign(s);
+        return *this;
+    }
+
+    allocator_type get_allocator() const noexcept { return static_cast<const Alloc &>(*this); }
+
+    bool is_inline() const noexcept { return tag() != heap_tag; }
+
+    size_type size() const noexcept { return is_inline() ? InlineCap - tag() : heap().size; }
+    size_type capacity() const noexcept { return is_inline() ? InlineCap : heap().cap; }
+    bool empty() const noexcept { return size() == 0; }
+
+    const char *data() const noexcept { return is_inline() ? raw_ : heap().ptr; }
+    char *data() noexcept { return is_inline() ? raw_ : heap().ptr; }
+    const char *c_str() const noexcept { return data(); }
+
+    const char *begin() const noexcept { return data(); }
+    const char *end() const noexcept { return data() + size(); }
+
+    char operator[](size_type pos) const noexcept { return data()[pos]; }
+    char &operator[](size_type pos) noexcept { return data()[pos]; }
+
+    std::string_view view() const noexcept { return {data(), size()}; }
+    operator std::string_view() const noexcept { return view(); }
+
+    void clear() noexcept { resize_to(0); }
+
+    void reserve(size_type n)
+    {
+        if (n > capacity())
+            reallocate(n, {});
+    }
+
+    void assign(std::string_view s)
+    {
+        if (s.size() > capacity())
+        {
+            // nothing to keep, drop the old buffer first
+            release();
+            set_inline_size(0);
+            reserve(s.size());
+        }
+        std::memmove(data(), s.data(), s.size());
+        resize_to(s.size());
+    }
+
+    basic_small_string &append(std::string_view s)
+    {
+        const size_type len = size();
+        if (len + s.size() > capacity())
+        {
+            // s may point into this string, so it is copied before the old buffer goes
+            reallocate(std::max(len + s.size(), capacity() * 2), s);
+            return *this;
+        }
+        std::memcpy(data() + len, s.data(), s.size());
+        resize_to(len + s.size());
+        return *this;
+    }
+
+    void push_back(char c) { append(std::string_view(&c, 1)); }
+
+    friend bool operator==(const basic_small_string &a, const basic_small_string &b) noexcept { return a.view() == b.view(); }
+    friend bool operator!=(const basic_small_string &a, const basic_small_string &b) noexcept { return a.view() != b.view(); }
+    friend bool operator<(const basic_small_string &a, const basic_small_string &b) noexcept { return a.view() < b.view(); }
+    friend bool operator<(const basic_small_string &a, std::string_view b) noexcept { return a.view() < b; }
+    friend bool operator<(std::string_view a, const basic_small_string &b) noexcept { return a < b.view(); }
+
+private:
+    unsigned char tag() const noexcept { return static_cast<unsigned char>(raw_[InlineCap]); }
+
+    heap_rep heap() const noexcept
+    {
+        heap_rep h;
+        std::memcpy(&h, raw_, sizeof(h));
+        return h;
+    }
+
+    void set_heap(const heap_rep &h) noexcept
+    {
+        std::memcpy(raw_, &h, sizeof(h));
+        raw_[InlineCap] = static_cast<char>(heap_tag);
+    }
+
+    void set_inline_size(size_type n) noexcept
+    {
+        raw_[n] = '\0';
+        raw_[InlineCap] = static_cast<char>(InlineCap - n);
+    }
+
+    void resize_to(size_type n) noexcept
+    {
+        if (is_inline())
+        {
+            set_inline_size(n);
+            return;
+        }
+        heap_rep h = heap();
+        h.size = static_cast<std::uint32_t>(n);
+        h.ptr[n] = '\0';
+        set_heap(h);
+    }
+
+    // moves the contents followed by tail into a new buffer of n characters
+    void reallocate(size_type n, std::string_view tail)
+    {
+        if (n > UINT32_MAX - 1)
+            throw std::length_error("basic_small_string is limited to 4G characters");
+
+        Alloc &alloc = *this;
+        const size_type len = size();
+        char *p = traits::allocate(alloc, n + 1);
+        std::memcpy(p, data(), len);
+        if (!tail.empty())
+            std::memcpy(p + len, tail.data(), tail.size());
+        p[len + tail.size()] = '\0';
+        release();
+        set_heap(heap_rep{p, static_cast<std::uint32_t>(len + tail.size()), static_cast<std::uint32_t>(n)});
+    }
+
+    void release() noexcept
+    {
+        if (is_inline())
+            return;
+        Alloc &alloc = *this;
+        const heap_rep h = heap();
+        traits::deallocate(alloc, h.ptr, h.cap + 1);
+    }
+
+    alignas(heap_rep) char raw_[InlineCap + 1];
+};
+
+template <std::size_t InlineCap>
+using small_string = basic_small_string<InlineCap>;
+
+namespace pmr
+{
+    template <std::size_t InlineCap>
+    using small_string = basic_small_string<InlineCap, std::pmr::polymorphic_allocator<char>>;
+}
+
+namespace std
+{
+    template <std::size_t InlineCap, class Alloc>
+    struct hash<basic_small_string<InlineCap, Alloc>>
+    {
+        std::size_t operator()(const basic_small_string<InlineCap, Alloc> &s) const noexcept
+        {
+            return std::hash<std::string_view>()(s.view());
+        }
+    };
+}
+
+// Handle to a string stored once in a string_interner.
+// Equal handles of the same interner point to the same bytes, so equality is
+// a pointer comparison; ordering still compares the characters.
+class interned_string
+{
+public:
+    interned_string() noexcept = default;
+
+    std::string_view view() const noexcept
+    {
+        if (!p_)
+            return {};
+        std::uint32_t len;
+        std::memcpy(&len, p_, sizeof(len));
+        return {p_ + sizeof(len), len};
+    }
+
+    std::size_t size() const noexcept { return view().size(); }
+    const char *c_str() const noexcept { return p_ ? p_ + sizeof(std::uint32_t) : ""; }
+    operator std::string_view() const noexcept { return view(); }
+
+    friend bool operator==(interned_string a, interned_string b) noexcept { return a.p_ == b.p_; }
+    friend bool operator!=(interned_string a, interned_string b) noexcept { return a.p_ != b.p_; }
+    friend bool operator<(interned_string a, interned_string b) noexcept { return a.view() < b.view(); }
+    friend bool operator<(interned_string a, std::string_view b) noexcept { return a.view() < b; }
+    friend bool operator<(std::string_view a, interned_string b) noexcept { return a < b.view(); }
+
+private:
+    template <class>
+    friend class string_interner;
+
+    explicit interned_string(const char *p) noexcept : p_(p) {}
+
+    const char *p_ = nullptr; // [uint32 length][characters]['\0']
+};
+
+// Arena of unique strings: characters are bump-allocated from chunks taken
+// from Alloc and never move, the index only holds views into the chunks.
+template <class Alloc = std::allocator<char>>
+class string_interner : private Alloc
+{
+    using traits = std::allocator_traits<Alloc>;
+
+public:
+    static constexpr std::size_t chunk_size = 64 * 1024;
+
+    explicit string_interner(const Alloc &alloc = Alloc()) : Alloc(alloc) {}
+
+    string_interner(const string_interner &) = delete;
+    string_interner &operator=(const string_interner &) = delete;
+
+    ~string_interner()
+    {
+        Alloc &alloc = *this;
+        for (auto &c : chunks_)
+        {
+            traits::deallocate(alloc, c.first, c.second);
+        }
+    }
+
+    interned_string intern(std::string_view s)
+    {
+        auto it = index_.find(s);
+        if (it != index_.end())
+            return interned_string(it->data() - sizeof(std::uint32_t));
+
+        const std::size_t need = sizeof(std::uint32_t) + s.size() + 1;
+        if (need > static_cast<std::size_t>(end_ - cur_))
+            new_chunk(need);
+
+        const auto len = static_cast<std::uint32_t>(s.size());
+        char *p = cur_;
+        std::memcpy(p, &len, sizeof(len));
+        std::memcpy(p + sizeof(len), s.data(), s.size());
+        p[need - 1] = '\0';
+        cur_ += need;
+        index_.emplace(p + sizeof(len), s.size());
+        return interned_string(p);
+    }
+
+    std::size_t unique() const noexcept { return index_.size(); }
+    std::size_t chunk_bytes() const noexcept { return chunk_bytes_; }
+
+private:
+    void new_chunk(std::size_t need)
+    {
+        Alloc &alloc = *this;
+        const std::size_t size = std::max(need, chunk_size);
+        char *p = traits::allocate(alloc, size);
+        chunks_.emplace_back(p, size);
+        chunk_bytes_ += size;
+        cur_ = p;
+        end_ = p + size;
+    }
+
+    std::vector<std::pair<char *, std::size_t>> chunks_;
+    std::unordered_set<std::string_view> index_;
+    char *cur_ = nullptr;
+    char *end_ = nullptr;
+    std::size_t chunk_bytes_ = 0;
+};
+
+// upstream that tracks the bytes currently handed out
+class counting_resource : public std::pmr::memory_resource
+{
+public:
+    std::size_t bytes() const { return bytes_; }
+
+private:
+    void *do_allocate(std::size_t bytes, std::size_t align) override
+    {
+        bytes_ += bytes;
+        return std::pmr::new_delete_resource()->allocate(bytes, align);
+    }
+
+    void do_deallocate(void *p, std::size_t bytes, std::size_t align) override
+    {
+        bytes_ -= bytes;
+        std::pmr::new_delete_resource()->deallocate(p, bytes, align);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+    {
+        return this == &other;
+    }
+
+    std::size_t bytes_ = 0;
+};
+
+template <typename Func>
+auto benchmark(Func test_func, int iterations)
+{
+    const auto start = std::chrono::system_clock::now();
+    while (iterations-- > 0)
+    {
+        test_func();
+    }
+    const auto stop = std::chrono::system_clock::now();
+    const auto secs = std::chrono::duration<double>(stop - start);
+    return secs.count();
+}
+
+constexpr int total_keys{1'000'000};
+constexpr int distinct_keys{250'000};
+constexpr int total_lookups{1'000'000};
+
+// short keys of 8..30 characters, every key repeats about four times
+std::vector<std::string> make_keys()
+{
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> len(8, 30);
+    std::uniform_int_distribution<int> ch('a', 'z');
+    std::vector<std::string> distinct(distinct_keys);
+    for (auto &k : distinct)
+    {
+        k.resize(len(gen));
+        for (auto &c : k)
+        {
+            c = static_cast<char>(ch(gen));
+        }
+    }
+    std::uniform_int_distribution<int> pick(0, distinct_keys - 1);
+    std::vector<std::string> keys(total_keys);
+    for (auto &k : keys)
+    {
+        k = distinct[pick(gen)];
+    }
+    return keys;
+}
+
+// sorts the keys and runs binary searches, memory is reported by the caller
+template <typename Container>
+void sort_and_lookup(const char *name, Container &c, const std::vector<std::string> &probes, std::size_t bytes)
+{
+    const double sort_secs = benchmark([&]
+                                       { std::sort(c.begin(), c.end()); },
+                                       1);
+    long found = 0;
+    const double lookup_secs = benchmark([&]
+                                         {
+                                             for (const auto &p : probes)
+                                             {
+                                                 found += std::binary_search(c.begin(), c.end(), std::string_view(p));
+                                             } },
+                                         1);
+    std::cout << std::fixed << name << "sort = " << sort_secs << " sec; lookup = " << lookup_secs << " sec; found = " << found;
+    if (bytes)
+        std::cout << "; bytes/key = " << static_cast<double>(bytes) / c.size();
+    std::cout << '\n';
+}
+
+int main()
+{
+    static_assert(sizeof(small_string<23>) == 24, "empty allocator adds nothing");
+    static_assert(sizeof(small_string<31>) == 32, "empty allocator adds nothing");
+
+    const auto keys = make_keys();
+    std::vector<std::string> probes(keys.begin(), keys.begin() + total_lookups / 2);
+    for (int i{}; i != total_lookups / 2; ++i)
+    {
+        probes.push_back(keys[i] + "-miss");
+    }
+
+    std::cout << "sizeof: pmr::string = " << sizeof(std::pmr::string)
+              << ", pmr::small_string<23> = " << sizeof(pmr::small_string<23>)
+              << ", pmr::small_string<31> = " << sizeof(pmr::small_string<31>)
+              << ", interned_string = " << sizeof(interned_string) << '\n';
+
+    {
+        counting_resource counter;
+        std::pmr::vector<std::pmr::string> c{&counter};
+        c.reserve(total_keys);
+        for (const auto &k : keys)
+        {
+            c.emplace_back(k);
+        }
+        sort_and_lookup("t1 (pmr::string):            ", c, probes, counter.bytes());
+    }
+
+    {
+        counting_resource counter;
+        std::pmr::vector<pmr::small_string<23>> c{&counter};
+        c.reserve(total_keys);
+        for (const auto &k : keys)
+        {
+            c.emplace_back(k);
+        }
+        sort_and_lookup("t2 (pmr::small_string<23>):  ", c, probes, counter.bytes());
+    }
+
+    {
+        counting_resource counter;
+        std::pmr::vector<pmr::small_string<31>> c{&counter};
+        c.reserve(total_keys);
+        for (const auto &k : keys)
+        {
+            c.emplace_back(k);
+        }
+        sort_and_lookup("t3 (pmr::small_string<31>):  ", c, probes, counter.bytes());
+    }
+
+    {
+        counting_resource counter;
+        string_interner<std::pmr::polymorphic_allocator<char>> interner{&counter};
+        std::pmr::vector<interned_string> c{&counter};
+        c.reserve(total_keys);
+        for (const auto &k : keys)
+        {
+            c.push_back(interner.intern(k));
+        }
+        // the hash index lives on the default heap, count it approximately
+        const std::size_t index_bytes = interner.unique() * (sizeof(std::string_view) + 2 * sizeof(void *));
+        sort_and_lookup("t4 (interned_string):        ", c, probes, counter.bytes() + index_bytes);
+    }
+
+    // ordered_free walks the pool's free list, so the boost pools get a tenth of the keys
+    const std::vector<std::string> pool_keys(keys.begin(), keys.begin() + total_keys / 10);
+
+    {
+        Pool pool(sizeof(char));
+        using alloc = my_pool_alloc<char>;
+        std::vector<basic_small_string<23, alloc>> c;
+        c.reserve(pool_keys.size());
+        for (const auto &k : pool_keys)
+        {
+            c.emplace_back(k, alloc(pool));
+        }
+        sort_and_lookup("t5 (small_string<23>, my_pool_alloc): ", c, probes, 0);
+    }
+
+    {
+        using alloc = boost::pool_allocator<char>;
+        std::vector<basic_small_string<23, alloc>> c;
+        c.reserve(pool_keys.size());
+        for (const auto &k : pool_keys)
+        {
+            c.emplace_back(k);
+        }
+        sort_and_lookup("t6 (small_string<23>, boost::pool_allocator): ", c, probes, 0);
+    }
+
+    return 0;
+}
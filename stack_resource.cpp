@@ -0,0 +1,288 @@
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+// per-thread pool for requests that do not fit into an inline buffer
+inline std::pmr::memory_resource *thread_pool_resource()
+{
+    thread_local std::pmr::unsynchronized_pool_resource pool;
+    return &pool;
+}
+
+// N bytes of inline storage handed out monotonically.
+// Freeing the most recent block rolls the pointer back, which only helps when
+// nothing was allocated after it. A growing vector allocates its new buffer
+// before it frees the old one, so every capacity it passes through stays used:
+// growing to capacity C takes about 2 * C elements of space, unless the vector
+// reserves C up front. Requests that do not fit go to the upstream, by default
+// the pool of the calling thread.
+// The buffer is left uninitialized, so the resource costs a few stores to create.
+template <std::size_t N>
+class stack_resource : public std::pmr::memory_resource
+{
+public:
+    explicit stack_resource(std::pmr::memory_resource *upstream = thread_pool_resource()) noexcept
+        : upstream_(upstream), cur_(buf_) {}
+
+    stack_resource(const stack_resource &) = delete;
+    stack_resource &operator=(const stack_resource &) = delete;
+
+    std::pmr::memory_resource *upstream_resource() const noexcept { return upstream_; }
+    std::size_t used() const noexcept { return static_cast<std::size_t>(cur_ - buf_); }
+    std::size_t overflows() const noexcept { return overflows_; }
+
+private:
+    bool owns(const void *p) const noexcept
+    {
+        auto *b = static_cast<const std::byte *>(p);
+        return b >= buf_ && b < buf_ + N;
+    }
+
+    void *do_allocate(std::size_t bytes, std::size_t align) override
+    {
+        auto addr = reinterpret_cast<std::uintptr_t>(cur_);
+        auto aligned = (addr + align - 1) & ~static_cast<std::uintptr_t>(align - 1);
+        std::byte *p = cur_ + (aligned - addr);
+        if (p + bytes <= buf_ + N)
+        {
+            cur_ = p + bytes;
+            return p;
+        }
+        ++overflows_;
+        return upstream_->allocate(bytes, align);
+    }
+
+    void do_deallocate(void *p, std::size_t bytes, std::size_t align) override
+    {
+        if (!owns(p))
+        {
+            upstream_->deallocate(p, bytes, align);
+            return;
+        }
+        if (static_cast<std::byte *>(p) + bytes == cur_)
+            cur_ = static_cast<std::byte *>(p);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+    {
+        return this == &other;
+    }
+
+    std::pmr::memory_resource *upstream_;
+    std::byte *cur_;
+    std::size_t overflows_ = 0;
+    alignas(std::max_align_t) std::byte buf_[N];
+};
+
+// the resource has to be constructed before the vector that points to it
+template <std::size_t N>
+struct stack_resource_holder
+{
+    stack_resource_holder() = default;
+    stack_resource_holder(const stack_resource_holder &) {}
+    stack_resource_holder &operator=(const stack_resource_holder &) { return *this; }
+
+    stack_resource<N> inline_res;
+};
+
+// pmr::vector with room for N elements inside the object itself.
+// Copies and moves always re-home the elements into their own inline buffer.
+// The vector base is private: moving out through a pmr::vector reference would
+// steal a buffer that lives inside this object.
+template <class T, std::size_t N>
+class inline_pmr_vector : private stack_resource_holder<N * sizeof(T)>, private std::pmr::vector<T>
+{
+    using holder = stack_resource_holder<N * sizeof(T)>;
+    using base = std::pmr::vector<T>;
+
+public:
+    using typename base::value_type;
+    using typename base::size_type;
+    using typename base::reference;
+    using typename base::const_reference;
+    using typename base::iterator;
+    using typename base::const_iterator;
+
+    using base::assign;
+    using base::at;
+    using base::back;
+    using base::begin;
+    using base::capacity;
+    using base::cbegin;
+    using base::cend;
+    using base::clear;
+    using base::data;
+    using base::emplace;
+    using base::emplace_back;
+    using base::empty;
+    using base::end;
+    using base::erase;
+    using base::front;
+    using base::get_allocator;
+    using base::insert;
+    using base::pop_back;
+    using base::push_back;
+    using base::reserve;
+    using base::resize;
+    using base::size;
+    using base::operator[];
+
+    inline_pmr_vector() : base(&this->inline_res) { base::reserve(N); }
+
+    inline_pmr_vector(std::initializer_list<T> init) : inline_pmr_vector()
+    {
+        base::assign(init);
+    }
+
+    inline_pmr_vector(const inline_pmr_vector &other) : holder(), base(&this->inline_res)
+    {
+        base::reserve(N);
+        base::assign(other.begin(), other.end());
+    }
+
+    inline_pmr_vector(inline_pmr_vector &&other) : holder(), base(&this->inline_res)
+    {
+        base::reserve(N);
+        for (auto &v : other)
+        {
+            base::push_back(std::move(v));
+        }
+    }
+
+    inline_pmr_vector &operator=(const inline_pmr_vector &) = default;
+    inline_pmr_vector &operator=(inline_pmr_vector &&) = default;
+
+    const stack_resource<N * sizeof(T)> &storage() const { return this->inline_res; }
+};
+
+// default resource that counts what reaches the heap
+class counting_resource : public std::pmr::memory_resource
+{
+public:
+    std::size_t calls() const { return calls_; }
+
+private:
+    void *do_allocate(std::size_t bytes, std::size_t align) override
+    {
+        ++calls_;
+        return std::pmr::new_delete_resource()->allocate(bytes, align);
+    }
+
+    void do_deallocate(void *p, std::size_t bytes, std::size_t align) override
+    {
+        std::pmr::new_delete_resource()->deallocate(p, bytes, align);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+    {
+        return this == &other;
+    }
+
+    std::size_t calls_ = 0;
+};
+
+// outlives the thread-local pool that uses it as upstream
+counting_resource heap;
+
+template <typename Func>
+auto benchmark(Func test_func, int iterations)
+{
+    const auto start = std::chrono::system_clock::now();
+    while (iterations-- > 0)
+    {
+        test_func();
+    }
+    const auto stop = std::chrono::system_clock::now();
+    const auto secs = std::chrono::duration<double>(stop - start);
+    return secs.count();
+}
+
+// hot function: collects a few values in a temporary container
+template <typename Vector>
+long hot_path(Vector &v, int elements, int seed)
+{
+    for (int i{}; i != elements; ++i)
+    {
+        v.push_back(seed + i);
+    }
+    long sum = 0;
+    for (auto x : v)
+    {
+        sum += x;
+    }
+    return sum;
+}
+
+void test_allocs(int elements)
+{
+    constexpr int iterations{2'000'000};
+    constexpr std::size_t inline_elements{64};
+
+    long sum = 0;
+    std::size_t spills = 0;
+    int seed = 0;
+
+    std::size_t before = heap.calls();
+    const double t1 = benchmark([&]
+                                {
+                                    std::pmr::vector<long> v;
+                                    sum += hot_path(v, elements, seed++); },
+                                iterations);
+    const std::size_t c1 = heap.calls() - before;
+
+    before = heap.calls();
+    const double t2 = benchmark([&]
+                                {
+                                    // growing one capacity at a time up to 64 takes 1 + 2 + ... + 64 slots
+                                    stack_resource<2 * inline_elements * sizeof(long)> res;
+                                    std::pmr::vector<long> v{&res};
+                                    sum += hot_path(v, elements, seed++);
+                                    spills += res.overflows(); },
+                                iterations);
+    const std::size_t c2 = heap.calls() - before;
+    const std::size_t s2 = spills;
+
+    before = heap.calls();
+    const double t3 = benchmark([&]
+                                {
+                                    inline_pmr_vector<long, inline_elements> v;
+                                    sum += hot_path(v, elements, seed++);
+                                    spills += v.storage().overflows(); },
+                                iterations);
+    const std::size_t c3 = heap.calls() - before;
+    const std::size_t s3 = spills - s2;
+
+    std::cout << std::fixed << elements << " elements per call (" << inline_elements << " inline):\n"
+              << "  t1 (pmr::vector, default resource):         " << t1 << " sec; heap allocs/call = "
+              << static_cast<double>(c1) / iterations << '\n'
+              << "  t2 (pmr::vector, stack_resource, " << 2 * inline_elements << " slots): " << t2 << " sec; heap allocs/call = "
+              << static_cast<double>(c2) / iterations << "; pool spills/call = "
+              << static_cast<double>(s2) / iterations << '\n'
+              << "  t3 (inline_pmr_vector):                     " << t3 << " sec; heap allocs/call = "
+              << static_cast<double>(c3) / iterations << "; pool spills/call = "
+              << static_cast<double>(s3) / iterations << '\n'
+              << "  checksum: " << sum << '\n';
+}
+
+int main()
+{
+    // everything below, including the thread pool's chunks, is counted
+    std::pmr::set_default_resource(&heap);
+
+    inline_pmr_vector<std::pmr::string, 8> names{"a", "b", "c"};
+    auto copy = names;
+    copy.push_back("a string that does not fit into the SSO buffer of pmr::string");
+    std::cout << "names: " << names.size() << ", copy: " << copy.size()
+              << ", inline bytes used by copy: " << copy.storage().used() << std::endl;
+
+    test_allocs(8);
+    test_allocs(48);
+    test_allocs(200); // does not fit, falls back to the thread pool
+
+    return 0;
+}
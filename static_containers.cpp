@@ -0,0 +1,548 @@
+#include "my_pool_alloc.h"
+
+#include <boost/pool/pool_alloc.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Vector with its N elements inside the object: no allocator, no heap.
+// For trivial T the storage is a plain T[N], so the vector is trivially
+// copyable and every operation works in constant expressions; other types
+// live in raw bytes and are constructed and destroyed one by one.
+// Exceeding N throws std::length_error, a compile error in a constant expression.
+template <class T, std::size_t N>
+class static_vector
+{
+    static_assert(N > 0, "an empty static_vector holds nothing");
+
+    static constexpr bool trivial = std::is_trivial_v<T>;
+
+    struct raw
+    {
+        alignas(T) unsigned char bytes[sizeof(T) * N];
+    };
+
+public:
+    using value_type = T;
+    using size_type = std::size_t;
+    using iterator = T *;
+    using const_iterator = const T *;
+
+    // elements of a trivial T are only written at run time when pushed
+    constexpr static_vector() noexcept
+    {
+        if constexpr (trivial)
+        {
+            if (std::is_constant_evaluated())
+                std::fill(storage_, storage_ + N, T());
+        }
+    }
+
+    constexpr static_vector(std::initializer_list<T> init) : static_vector()
+    {
+        for (const T &x : init)
+        {
+            push_back(x);
+        }
+    }
+
+    constexpr static_vector(const static_vector &) requires trivial = default;
+    constexpr static_vector(const static_vector &other) : static_vector()
+    {
+        for (const T &x : other)
+        {
+            emplace_back(x);
+        }
+    }
+
+    constexpr static_vector(static_vector &&) noexcept requires trivial = default;
+    constexpr static_vector(static_vector &&other) noexcept(std::is_nothrow_move_constructible_v<T>) : static_vector()
+    {
+        for (T &x : other)
+        {
+            emplace_back(std::move(x));
+        }
+    }
+
+    constexpr static_vector &operator=(const static_vector &) requires trivial = default;
+    constexpr static_vector &operator=(const static_vector &other)
+    {
+        if (this != &other)
+        {
+            clear();
+            for (const T &x : other)
+            {
+                emplace_back(x);
+            }
+        }
+        return *this;
+    }
+
+    constexpr static_vector &operator=(static_vector &&) noexcept requires trivial = default;
+    constexpr static_vector &operator=(static_vector &&other) noexcept(std::is_nothrow_move_constructible_v<T>)
+    {
+        if (this != &other)
+        {
+            clear();
+            for (T &x : other)
+            {
+                emplace_back(std::move(x));
+            }
+        }
+        return *this;
+    }
+
+    constexpr ~static_vector() requires trivial = default;
+    constexpr ~static_vector() { clear(); }
+
+    template <class... Args>
+    constexpr T &emplace_back(Args &&...args)
+    {
+        if (size_ == N)
+            throw std::length_error("static_vector is full");
+        T *p = data() + size_;
+        if constexpr (trivial)
+            *p = T(std::forward<Args>(args)...);
+        else
+            std::construct_at(p, std::forward<Args>(args)...);
+        ++size_;
+        return *p;
+    }
+
+    constexpr void push_back(const T &x) { emplace_back(x); }
+    constexpr void push_back(T &&x) { emplace_back(std::move(x)); }
+
+    constexpr void pop_back()
+    {
+        --size_;
+        std::destroy_at(data() + size_);
+    }
+
+    // shifts the tail up by one
+    constexpr iterator insert(const_iterator pos, const T &x)
+    {
+        const size_type i = static_cast<size_type>(pos - begin());
+        if (i == size_)
+        {
+            emplace_back(x);
+            return begin() + i;
+        }
+        T copy(x);
+        emplace_back(std::move(back()));
+        std::move_backward(begin() + i, end() - 2, end() - 1);
+        (*this)[i] = std::move(copy);
+        return begin() + i;
+    }
+
+    constexpr iterator erase(const_iterator pos)
+    {
+        const size_type i = static_cast<size_type>(pos - begin());
+        std::move(begin() + i + 1, end(), begin() + i);
+        pop_back();
+        return begin() + i;
+    }
+
+    constexpr void clear() noexcept
+    {
+        if constexpr (trivial)
+        {
+            size_ = 0;
+        }
+        else
+        {
+            while (size_)
+            {
+                pop_back();
+            }
+        }
+    }
+
+    constexpr T &operator[](size_type i) { return data()[i]; }
+    constexpr const T &operator[](size_type i) const { return data()[i]; }
+
+    constexpr T &at(size_type i)
+    {
+        if (i >= size_)
+            throw std::out_of_range("Out of bounds element access");
+        return data()[i];
+    }
+    constexpr const T &at(size_type i) const
+    {
+        if (i >= size_)
+            throw std::out_of_range("Out of bounds element access");
+        return data()[i];
+    }
+
+    constexpr T &front() { return data()[0]; }
+    constexpr T &back() { return data()[size_ - 1]; }
+    constexpr const T &front() const { return data()[0]; }
+    constexpr const T &back() const { return data()[size_ - 1]; }
+
+    constexpr T *data() noexcept
+    {
+        if constexpr (trivial)
+            return storage_;
+        else
+            return std::launder(reinterpret_cast<T *>(storage_.bytes));
+    }
+    constexpr const T *data() const noexcept
+    {
+        if constexpr (trivial)
+            return storage_;
+        else
+            return std::launder(reinterpret_cast<const T *>(storage_.bytes));
+    }
+
+    constexpr iterator begin() noexcept { return data(); }
+    constexpr iterator end() noexcept { return data() + size_; }
+    constexpr const_iterator begin() const noexcept { return data(); }
+    constexpr const_iterator end() const noexcept { return data() + size_; }
+
+    constexpr size_type size() const noexcept { return size_; }
+    constexpr bool empty() const noexcept { return size_ == 0; }
+    constexpr bool full() const noexcept { return size_ == N; }
+    static constexpr size_type capacity() noexcept { return N; }
+
+private:
+    std::conditional_t<trivial, T[N], raw> storage_;
+    size_type size_ = 0;
+};
+
+template <class T, std::size_t N>
+constexpr bool operator==(const static_vector<T, N> &a, const static_vector<T, N> &b)
+{
+    return std::equal(a.begin(), a.end(), b.begin(), b.end());
+}
+
+// Map of at most N entries kept sorted by key in a static_vector: binary
+// search to find, the tail moves up or down on insert and erase. Entries are
+// plain aggregates, so with trivial K and V the whole map is trivially
+// copyable and can be built as a constexpr lookup table.
+template <class K, class V, std::size_t N, class Compare = std::less<K>>
+class static_flat_map
+{
+public:
+    struct value_type
+    {
+        K first;
+        V second;
+    };
+    using key_type = K;
+    using mapped_type = V;
+    using iterator = value_type *;
+    using const_iterator = const value_type *;
+
+    constexpr static_flat_map() = default;
+
+    // a later duplicate key replaces the value of an earlier one
+    constexpr static_flat_map(std::initializer_list<value_type> init)
+    {
+        for (const value_type &e : init)
+        {
+            insert_or_assign(e.first, e.second);
+        }
+    }
+
+    constexpr iterator lower_bound(const K &key)
+    {
+        return std::lower_bound(entries_.begin(), entries_.end(), key, key_less());
+    }
+    constexpr const_iterator lower_bound(const K &key) const
+    {
+        return std::lower_bound(entries_.begin(), entries_.end(), key, key_less());
+    }
+
+    constexpr iterator find(const K &key)
+    {
+        iterator it = lower_bound(key);
+        return it != end() && !Compare()(key, it->first) ? it : end();
+    }
+    constexpr const_iterator find(const K &key) const
+    {
+        const_iterator it = lower_bound(key);
+        return it != end() && !Compare()(key, it->first) ? it : end();
+    }
+
+    constexpr bool contains(const K &key) const { return find(key) != end(); }
+
+    constexpr V &at(const K &key)
+    {
+        iterator it = find(key);
+        if (it == end())
+            throw std::out_of_range("static_flat_map: no such key");
+        return it->second;
+    }
+    constexpr const V &at(const K &key) const
+    {
+        const_iterator it = find(key);
+        if (it == end())
+            throw std::out_of_range("static_flat_map: no such key");
+        return it->second;
+    }
+
+    // the entry stays as it is when the key is there already
+    constexpr std::pair<iterator, bool> insert(const K &key, const V &value)
+    {
+        iterator it = lower_bound(key);
+        if (it != end() && !Compare()(key, it->first))
+            return {it, false};
+        return {entries_.insert(it, value_type{key, value}), true};
+    }
+
+    constexpr std::pair<iterator, bool> insert_or_assign(const K &key, const V &value)
+    {
+        auto r = insert(key, value);
+        if (!r.second)
+            r.first->second = value;
+        return r;
+    }
+
+    constexpr std::size_t erase(const K &key)
+    {
+        iterator it = find(key);
+        if (it == end())
+            return 0;
+        entries_.erase(it);
+        return 1;
+    }
+
+    constexpr void clear() noexcept { entries_.clear(); }
+
+    constexpr iterator begin() noexcept { return entries_.begin(); }
+    constexpr iterator end() noexcept { return entries_.end(); }
+    constexpr const_iterator begin() const noexcept { return entries_.begin(); }
+    constexpr const_iterator end() const noexcept { return entries_.end(); }
+
+    constexpr std::size_t size() const noexcept { return entries_.size(); }
+    constexpr bool empty() const noexcept { return entries_.empty(); }
+    static constexpr std::size_t capacity() noexcept { return N; }
+
+private:
+    struct key_less
+    {
+        constexpr bool operator()(const value_type &e, const K &key) const { return Compare()(e.first, key); }
+    };
+
+    static_vector<value_type, N> entries_;
+};
+
+// pool_allocator of simple_allocator.cpp: one static array and one shared
+// position per element type, nothing is ever given back
+template <class T>
+struct pool_allocator
+{
+    typedef T value_type;
+
+    static size_t pos;
+    static constexpr size_t size = sizeof(T) * 1000;
+    alignas(T) static uint8_t data[size];
+
+    pool_allocator() noexcept {}
+    ~pool_allocator() {}
+
+    template <class U>
+    pool_allocator(const pool_allocator<U> &) noexcept {}
+
+    T *allocate(size_t n)
+    {
+        if (pos + n > size)
+            throw std::bad_alloc();
+
+        size_t cur = pos;
+        pos += n;
+        return reinterpret_cast<T *>(data) + cur;
+    }
+
+    void deallocate(T *, size_t) {}
+
+    template <class U>
+    struct rebind
+    {
+        typedef pool_allocator<U> other;
+    };
+};
+
+template <typename T>
+uint8_t pool_allocator<T>::data[size];
+
+template <typename T>
+size_t pool_allocator<T>::pos = 0;
+
+template <class T, class U>
+constexpr bool operator==(const pool_allocator<T> &, const pool_allocator<U> &) noexcept { return true; }
+
+template <class T, class U>
+constexpr bool operator!=(const pool_allocator<T> &, const pool_allocator<U> &) noexcept { return false; }
+
+constexpr int factorial(int n)
+{
+    return n == 0 ? 1 : n * factorial(n - 1);
+}
+
+// the benchmark's own constexpr copy of the m1/m2 table of my_boost_pool_alloc.cpp,
+// which still fills its maps at run time
+constexpr auto make_factorials()
+{
+    static_flat_map<int, int, 10> m;
+    for (int i = 9; i >= 0; --i)
+    {
+        m.insert(i, factorial(i));
+    }
+    return m;
+}
+
+constexpr auto factorials = make_factorials();
+static_assert(factorials.size() == 10 && factorials.at(5) == 120 && !factorials.contains(10));
+static_assert(std::is_trivially_copyable_v<decltype(factorials)>);
+static_assert(std::is_trivially_copyable_v<static_vector<int, 16>>);
+static_assert(!std::is_trivially_copyable_v<static_vector<std::string, 4>>);
+
+template <typename Func>
+auto benchmark(Func test_func, int iterations)
+{
+    const auto start = std::chrono::system_clock::now();
+    while (iterations-- > 0)
+    {
+        test_func();
+    }
+    const auto stop = std::chrono::system_clock::now();
+    const auto secs = std::chrono::duration<double>(stop - start);
+    return secs.count();
+}
+
+// a short list built, read and dropped, as a request handler would
+constexpr int elements{16};
+
+template <class Vector>
+long fill_and_sum(Vector &v, int seed)
+{
+    for (int i = 0; i < elements; ++i)
+    {
+        v.push_back(seed + i);
+    }
+    long sum = 0;
+    for (int x : v)
+    {
+        sum += x;
+    }
+    return sum;
+}
+
+void test_vector()
+{
+    constexpr int iterations{10'000'000};
+    long sum = 0;
+    int seed = 0;
+
+    const double t1 = benchmark([&]
+                                {
+                                    std::vector<int> v;
+                                    sum += fill_and_sum(v, ++seed); },
+                                iterations);
+
+    const double t2 = benchmark([&]
+                                {
+                                    // the shared position has to be rewound by hand
+                                    pool_allocator<int>::pos = 0;
+                                    std::vector<int, pool_allocator<int>> v;
+                                    sum += fill_and_sum(v, ++seed); },
+                                iterations);
+
+    const double t3 = benchmark([&]
+                                {
+                                    static_vector<int, elements> v;
+                                    sum += fill_and_sum(v, ++seed); },
+                                iterations);
+
+    std::cout << std::fixed << iterations << " vectors of " << elements << " ints filled and summed:\n"
+              << "  t1 (std::vector):                 " << t1 << " sec\n"
+              << "  t2 (std::vector, pool_allocator): " << t2 << " sec\n"
+              << "  t3 (static_vector):               " << t3 << " sec\n"
+              << "  checksum: " << sum << '\n';
+}
+
+// fill of m1/m2 in my_boost_pool_alloc.cpp, then a lookup of every key
+void test_factorial_map()
+{
+    constexpr int iterations{1'000'000};
+    long sum = 0;
+
+    const double t1 = benchmark([&]
+                                {
+                                    std::map<int, int, std::less<int>, boost::pool_allocator<std::pair<const int, int>>> m1;
+                                    for (int i = 0; i < 10; ++i)
+                                    {
+                                        m1.insert(std::pair<int, int>(i, factorial(i)));
+                                    }
+                                    for (int i = 0; i < 10; ++i)
+                                    {
+                                        sum += m1.find(i)->second;
+                                    } },
+                                iterations);
+
+    Pool nodes(64);
+    const double t2 = benchmark([&]
+                                {
+                                    std::map<int, int, std::less<int>, my_pool_alloc<std::pair<const int, int>>> m2{
+                                        my_pool_alloc<std::pair<const int, int>>(nodes)};
+                                    for (int i = 0; i < 10; ++i)
+                                    {
+                                        m2.insert(std::pair<int, int>(i, factorial(i)));
+                                    }
+                                    for (int i = 0; i < 10; ++i)
+                                    {
+                                        sum += m2.find(i)->second;
+                                    } },
+                                iterations);
+
+    const double t3 = benchmark([&]
+                                {
+                                    static_flat_map<int, int, 10> m;
+                                    for (int i = 0; i < 10; ++i)
+                                    {
+                                        m.insert(i, factorial(i));
+                                    }
+                                    for (int i = 0; i < 10; ++i)
+                                    {
+                                        sum += m.find(i)->second;
+                                    } },
+                                iterations);
+
+    // the table exists before main, only the lookups are left
+    int key = 0;
+    const double t4 = benchmark([&]
+                                {
+                                    for (int i = 0; i < 10; ++i)
+                                    {
+                                        sum += factorials.find((key + i) % 10)->second;
+                                    }
+                                    ++key; },
+                                iterations);
+
+    std::cout << std::fixed << iterations << " factorial maps of 10 entries filled and looked up:\n"
+              << "  t1 (std::map, boost::pool_allocator):   " << t1 << " sec\n"
+              << "  t2 (std::map, my_pool_alloc):           " << t2 << " sec\n"
+              << "  t3 (static_flat_map):                   " << t3 << " sec\n"
+              << "  t4 (constexpr static_flat_map, lookups): " << t4 << " sec\n"
+              << "  checksum: " << sum << '\n';
+}
+
+int main()
+{
+    test_vector();
+    test_factorial_map();
+
+    return 0;
+}